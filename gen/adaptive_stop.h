@@ -0,0 +1,81 @@
+#ifndef __adaptive_stop_h
+#define __adaptive_stop_h
+
+// Adaptive stopping (-target_err X)
+//
+// Instead of a fixed -n, events are generated until the relative error
+// on the accepted cross section sigma*eff falls below X, with
+//   (d(sigma eff) / sigma eff)^2 = (dsigma/sigma)^2 + (1 - eff)/npass
+// using Pythia's sigmaErr and the binomial error of the (unweighted)
+// efficiency of the first detector.  -nmin and -nmax bound the number
+// of tried events.  With several generators their latest estimates of
+// sigma are combined as at the end of the run.
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <climits>
+
+#include "cxn_combine.h"
+
+using namespace std;
+
+class AdaptiveStop {
+
+public:
+
+  double target;        // relative error, 0 when off
+  long nmin, nmax;      // bounds on the tried events
+  long check_every;     // tried events between two checks
+
+  AdaptiveStop(): target(0), nmin(1000), nmax(LONG_MAX), check_every(100),
+    next_check(0) {}
+
+  bool enabled() const {return target > 0;}
+
+  // Latest cross section estimate of generator igen
+  void set_cxn(int igen, double cxn, double err){
+    if(igen >= int(cxn_gen.size()))
+      cxn_gen.resize(igen + 1, make_pair(0.0, 0.0));
+    cxn_gen[igen] = make_pair(cxn, err);
+  }
+
+  // Relative error on sigma*eff after ntotal tried events of which
+  // npass were accepted, infinite while nothing passed
+  static double rel_err(double cxn, double cxn_err, long ntotal, long npass){
+    if(npass <= 0 || ntotal <= 0 || cxn <= 0)
+      return HUGE_VAL;
+    double eff = npass/double(ntotal);
+    double r = cxn_err/cxn;
+    return sqrt(r*r + (1 - eff)/npass);
+  }
+
+  // True once the run can stop.  ntotal can jump by more than one
+  // (events over budget), so checks are due from a threshold on.
+  bool done(long ntotal, long npass){
+    if(ntotal >= nmax)
+      return true;
+    if(ntotal < nmin || ntotal < next_check)
+      return false;
+    next_check = ntotal + check_every;
+
+    CxnCombiner combined;
+    for(size_t g=0; g<cxn_gen.size(); ++g)
+      combined.add(cxn_gen[g].first, cxn_gen[g].second, 1);
+    return rel_err(combined.cxn(), combined.err(), ntotal, npass) <= target;
+  }
+
+  // Why the run stopped, from its final numbers
+  string reason(double achieved, bool lhe_eof) const {
+    if(achieved <= target)
+      return "target";
+    return lhe_eof ? "lhe_eof" : "nmax";
+  }
+
+private:
+
+  vector<pair<double, double> > cxn_gen;
+  long next_check;
+};
+
+#endif
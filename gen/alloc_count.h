@@ -0,0 +1,131 @@
+#ifndef __alloc_count_h
+#define __alloc_count_h
+
+// Allocation counting by stage of the event loop
+//
+// Compiled with -DALLOC_COUNT, the global operator new is replaced by
+// one that counts every allocation against the stage the calling
+// thread is in (set with AllocScope), so that allocations per event
+// can be reported for our own code separately from Pythia and Delphes.
+// The counts are also taken after ALLOC_WARMUP tried events, once the
+// reused containers have grown to size, so that the steady state of
+// the loop is reported on its own.  Without ALLOC_COUNT everything here
+// compiles to nothing.
+//
+// Only include this from the file holding main(): it defines the
+// replacement operators.
+
+#include <iostream>
+
+using namespace std;
+
+enum AllocStage {ALLOC_NONE, ALLOC_GENERATION, ALLOC_DETECTOR,
+                 ALLOC_SELECTION, ALLOC_OUTPUT, ALLOC_NSTAGE};
+
+#define ALLOC_WARMUP 1000
+
+#ifdef ALLOC_COUNT
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+atomic<long>* alloc_counts(){
+  static atomic<long> counts[ALLOC_NSTAGE];
+  return counts;
+}
+
+// Counts at the end of the warm-up, and the events tried by then
+long* alloc_warm_counts(){
+  static long counts[ALLOC_NSTAGE];
+  return counts;
+}
+
+long& alloc_warm_nevt(){
+  static long nevt = 0;
+  return nevt;
+}
+
+int& alloc_stage(){
+  static thread_local int stage = ALLOC_NONE;
+  return stage;
+}
+
+void* operator new(size_t n){
+  alloc_counts()[alloc_stage()].fetch_add(1, memory_order_relaxed);
+  void* p = malloc(n ? n : 1);
+  if(!p)
+    throw bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t n){ return operator new(n); }
+
+void* operator new(size_t n, const nothrow_t&) noexcept {
+  alloc_counts()[alloc_stage()].fetch_add(1, memory_order_relaxed);
+  return malloc(n ? n : 1);
+}
+
+void* operator new[](size_t n, const nothrow_t& t) noexcept {
+  return operator new(n, t);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Attribute the allocations of this thread to a stage until the end
+// of the scope
+class AllocScope {
+public:
+  AllocScope(AllocStage stage): saved(alloc_stage()) { alloc_stage() = stage; }
+  ~AllocScope(){ alloc_stage() = saved; }
+private:
+  int saved;
+};
+
+// Once per tried event; takes the counts the first time nevt reaches
+// ALLOC_WARMUP
+void alloc_mark(long nevt){
+  if(alloc_warm_nevt() > 0 || nevt < ALLOC_WARMUP)
+    return;
+  for(int i=0; i<ALLOC_NSTAGE; ++i)
+    alloc_warm_counts()[i] = alloc_counts()[i].load();
+  alloc_warm_nevt() = nevt;
+}
+
+void print_alloc_counts(ostream& out, long nevt){
+  const char* names[ALLOC_NSTAGE] = {"other", "generation", "detector",
+                                     "selection", "output"};
+  streamsize precision = out.precision(3);
+  out<<"INFO: allocations per event:";
+  for(int i=ALLOC_GENERATION; i<ALLOC_NSTAGE; ++i)
+    out<<" "<<names[i]<<" "
+       <<(nevt > 0 ? alloc_counts()[i].load()/double(nevt) : 0);
+  out<<endl;
+
+  long steady = nevt - alloc_warm_nevt();
+  if(alloc_warm_nevt() > 0 && steady > 0){
+    out<<"INFO: allocations per event after "<<alloc_warm_nevt()<<" events:";
+    for(int i=ALLOC_GENERATION; i<ALLOC_NSTAGE; ++i)
+      out<<" "<<names[i]<<" "
+         <<(alloc_counts()[i].load() - alloc_warm_counts()[i])/double(steady);
+    out<<endl;
+  }
+  out.precision(precision);
+}
+
+#else
+
+class AllocScope {
+public:
+  AllocScope(AllocStage) {}
+};
+
+void alloc_mark(long) {}
+void print_alloc_counts(ostream&, long) {}
+
+#endif
+
+#endif
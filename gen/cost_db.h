@@ -0,0 +1,251 @@
+#ifndef __cost_db_h
+#define __cost_db_h
+
+// Cost database of generator runs, and a predictor for unseen points
+//
+// A run with -cost_db file appends one line of key=value pairs, the
+// model parameters followed by what the run cost:
+//
+//   mode=tchannel lambda=10 phimass=20 inv=0.3 Nc=2 NFf=2 NBf=0
+//   mphi=1000 ptcut=600 nevt=1000 procs=1 init_sec=14.2
+//   cpu_per_evt=0.051 wall_per_evt=0.049 mult=1432 eff=0.31 rss_mb=410
+//
+// nevt counts the tried events, cpu_per_evt is in core-seconds per
+// tried event (threads and forked workers included), mult the mean
+// size of the Pythia event record, eff the acceptance of the first
+// detector and rss_mb the peak memory of one process.  The predictor
+// estimates init_sec, cpu_per_evt, mult, eff and rss_mb of a new point by
+// inverse-distance weighting of the k nearest runs of the same mode,
+// in the model parameters scaled by their spread in the database
+// (lambda, phimass, mphi and ptcut on a log scale); cpu_per_evt, mult
+// and eff are interpolated in log.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "CmdLine/CmdLine.hh"
+
+using namespace std;
+
+static const int ncost_params = 8;
+static const char* const cost_params[ncost_params] =
+  {"lambda", "phimass", "inv", "Nc", "NFf", "NBf", "mphi", "ptcut"};
+static const bool cost_param_log[ncost_params] =
+  {true, true, false, false, false, false, true, true};
+
+struct CostRecord {
+  string mode;
+  map<string, double> values;
+
+  double get(const string& key, double def = 0) const {
+    map<string, double>::const_iterator it = values.find(key);
+    return it == values.end() ? def : it->second;
+  }
+
+  string str() const {
+    ostringstream sout;
+    sout << setprecision(6) << "mode=" << mode;
+    for(int i=0; i<ncost_params; ++i)
+      sout << " " << cost_params[i] << "=" << get(cost_params[i]);
+    for(map<string, double>::const_iterator it=values.begin(); it!=values.end(); ++it)
+      if(find(cost_params, cost_params + ncost_params, it->first) == cost_params + ncost_params)
+        sout << " " << it->first << "=" << it->second;
+    return sout.str();
+  }
+
+  bool parse(const string& line){
+    istringstream sin(line);
+    string item;
+    values.clear();
+    mode = "";
+    while(sin >> item){
+      size_t eq = item.find('=');
+      if(eq == string::npos)
+        return false;
+      if(item.substr(0, eq) == "mode")
+        mode = item.substr(eq + 1);
+      else
+        values[item.substr(0, eq)] = atof(item.c_str() + eq + 1);
+    }
+    return mode != "";
+  }
+};
+
+// Wall time in seconds since the epoch
+double cost_wall_seconds(){
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+// CPU time of this process, its threads and its waited-for children
+double cost_cpu_seconds(){
+  double sec = 0;
+  struct rusage ru;
+  int who[] = {RUSAGE_SELF, RUSAGE_CHILDREN};
+  for(int i=0; i<2; ++i)
+    if(getrusage(who[i], &ru) == 0)
+      sec += ru.ru_utime.tv_sec + 1e-6*ru.ru_utime.tv_usec
+        + ru.ru_stime.tv_sec + 1e-6*ru.ru_stime.tv_usec;
+  return sec;
+}
+
+// Peak resident memory of one process, this one or a child (MB)
+double cost_max_rss_mb(){
+  long kb = 0;
+  struct rusage ru;
+  if(getrusage(RUSAGE_SELF, &ru) == 0)
+    kb = max(kb, long(ru.ru_maxrss));
+  if(getrusage(RUSAGE_CHILDREN, &ru) == 0)
+    kb = max(kb, long(ru.ru_maxrss));
+  return kb/1024.;
+}
+
+// Model parameters of a run, from monojet.exe options and defaults
+void read_cost_params(const CmdLine& cmdline, CostRecord& rec){
+  rec.mode = cmdline.value<string>("-m", "tchannel");
+  rec.values["lambda"] = cmdline.value<double>("-lambda", 10);
+  rec.values["phimass"] = cmdline.value<double>("-phimass", 20.0);
+  rec.values["inv"] = cmdline.value<double>("-inv", 0.3);
+  rec.values["Nc"] = cmdline.value<int>("-Nc", 2);
+  rec.values["NFf"] = cmdline.value<int>("-NFf", 2);
+  rec.values["NBf"] = cmdline.value<int>("-NBf", 0);
+  rec.values["mphi"] = cmdline.value<double>("-mphi", 1000.0);
+  rec.values["ptcut"] = cmdline.value<double>("-ptcut", 600.0);
+}
+
+// Append a record with a single write, so that concurrent jobs
+// sharing the database do not interleave their lines
+bool append_cost_record(const string& fname, const CostRecord& rec){
+  string line = rec.str() + "\n";
+  int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  bool ok = fd >= 0 && write(fd, line.data(), line.size()) == ssize_t(line.size());
+  if(fd >= 0)
+    close(fd);
+  if(!ok)
+    cerr<<"ERROR: cannot append to cost database "<<fname<<endl;
+  return ok;
+}
+
+class CostModel {
+
+public:
+
+  vector<CostRecord> records;
+
+  bool read(const string& fname){
+    ifstream fin(fname.c_str());
+    if(!fin.good()){
+      cerr<<"ERROR: cannot read cost database "<<fname<<endl;
+      return false;
+    }
+    string line;
+    CostRecord rec;
+    while(getline(fin, line))
+      if(line.size() && line[0] != '#' && rec.parse(line) &&
+         rec.get("cpu_per_evt") > 0)
+        records.push_back(rec);
+    return true;
+  }
+
+  // Fill init_sec, cpu_per_evt, mult, eff and rss_mb of point, false
+  // if there is no run of its mode
+  bool predict(CostRecord& point, int k = 4) const {
+    vector<const CostRecord*> same;
+    for(size_t i=0; i<records.size(); ++i)
+      if(records[i].mode == point.mode)
+        same.push_back(&records[i]);
+    if(same.empty())
+      return false;
+
+    // spread of each parameter
+    double scale[ncost_params];
+    for(int p=0; p<ncost_params; ++p){
+      double lo = HUGE_VAL, hi = -HUGE_VAL;
+      for(size_t i=0; i<same.size(); ++i){
+        double x = coordinate(*same[i], p);
+        lo = min(lo, x);
+        hi = max(hi, x);
+      }
+      scale[p] = hi > lo ? hi - lo : 1;
+    }
+
+    vector<pair<double, const CostRecord*> > dist;
+    for(size_t i=0; i<same.size(); ++i){
+      double d2 = 0;
+      for(int p=0; p<ncost_params; ++p){
+        double d = (coordinate(*same[i], p) - coordinate(point, p))/scale[p];
+        d2 += d*d;
+      }
+      dist.push_back(make_pair(sqrt(d2), same[i]));
+    }
+    sort(dist.begin(), dist.end());
+    if(int(dist.size()) > k)
+      dist.resize(k);
+
+    const char* keys[] = {"init_sec", "cpu_per_evt", "mult", "eff", "rss_mb"};
+    const bool in_log[] = {false, true, true, true, false};
+    for(int j=0; j<5; ++j){
+      double sum = 0, sum_w = 0;
+      for(size_t i=0; i<dist.size(); ++i){
+        // an exact match wins
+        double w = 1/(dist[i].first*dist[i].first + 1e-12);
+        double v = dist[i].second->get(keys[j]);
+        sum += w*(in_log[j] ? log(max(v, 1e-12)) : v);
+        sum_w += w;
+      }
+      point.values[keys[j]] = in_log[j] ? exp(sum/sum_w) : sum/sum_w;
+    }
+    point.values["nearest"] = dist[0].first;
+    return true;
+  }
+
+  // Core-seconds of a monojet.exe run with the options of cmdline,
+  // negative without a prediction.  point gets the predicted costs and
+  // the number of tried events: -n for LHE input, -n accepted events
+  // otherwise, and with -target_err the events for the binomial part
+  // of the error alone, bounded by -nmin and -nmax.
+  double run_cost(const CmdLine& cmdline, CostRecord& point, int k = 4) const {
+    read_cost_params(cmdline, point);
+    if(!predict(point, k))
+      return -1;
+
+    double eff = max(point.get("eff"), 1e-6);
+    double ntried;
+    if(cmdline.present("-target_err")){
+      double target = cmdline.value<double>("-target_err");
+      ntried = (1 - eff)/(eff*target*target);
+      ntried = max(ntried, double(cmdline.value<long>("-nmin", 1000)));
+      ntried = min(ntried, double(cmdline.value<long>("-nmax", 10000000)));
+    }
+    else if(point.mode == "lhe")
+      ntried = cmdline.value<int>("-n", 1000);
+    else
+      ntried = cmdline.value<int>("-n", 1000)/eff;
+
+    point.values["nevt"] = ntried;
+    return point.get("init_sec") + ntried*point.get("cpu_per_evt");
+  }
+
+private:
+
+  static double coordinate(const CostRecord& rec, int p){
+    double x = rec.get(cost_params[p]);
+    return cost_param_log[p] ? log(max(x, 1e-6)) : x;
+  }
+};
+
+#endif
@@ -0,0 +1,138 @@
+// Predict the cost of monojet.exe runs from a cost database
+//
+// Usage: cost_predict -db cost.db [-k (4)] [-margin (1.5)] (monojet.exe options)
+//        cost_predict -db cost.db [-k (4)] -grid grid.txt [-o sized.txt]
+//
+// The database is filled by monojet.exe -cost_db cost.db.  For a single
+// point the predicted costs are printed, followed by a line
+//
+//   resources time=HH:MM:SS mem=NNNmb cost=SEC
+//
+// with the wall time and memory of the run (-procs N processes) times
+// the margin, for batch scripts.  With -grid, every point of a
+// scan_runner grid gets cost= set to its predicted core-seconds,
+// points without a prediction keep theirs.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdio>
+
+#include "CmdLine/CmdLine.hh"
+#include "cost_db.h"
+
+using namespace std;
+
+// Set cost= of every point of a grid
+bool size_grid(const CostModel& model, int k, const string& grid, ostream& out){
+  ifstream fin(grid.c_str());
+  if(!fin.good()){
+    cerr<<"ERROR: cannot read grid "<<grid<<endl;
+    return false;
+  }
+
+  string line;
+  int npoints = 0, npredicted = 0;
+  while(getline(fin, line)){
+    string body = line.substr(0, line.find('#'));
+    istringstream sin(body);
+    string name, word;
+    if(!(sin >> name)){
+      out << line << "\n";
+      continue;
+    }
+    ++npoints;
+
+    vector<string> settings, args(1, "monojet.exe");
+    while(sin >> word){
+      if(args.size() > 1 || word[0] == '-')
+        args.push_back(word);
+      else if(word.compare(0, 5, "cost=") != 0)
+        settings.push_back(word);
+      else
+        settings.insert(settings.begin(), word);
+    }
+
+    CostRecord point;
+    double cost = model.run_cost(CmdLine(args), point, k);
+    if(cost >= 0){
+      ++npredicted;
+      if(!settings.empty() && settings[0].compare(0, 5, "cost=") == 0)
+        settings.erase(settings.begin());
+      ostringstream setting;
+      setting << "cost=" << ceil(cost);
+      settings.insert(settings.begin(), setting.str());
+    }
+
+    out << name;
+    for(size_t i=0; i<settings.size(); ++i)
+      out << " " << settings[i];
+    for(size_t i=1; i<args.size(); ++i)
+      out << " " << args[i];
+    out << "\n";
+  }
+
+  cout<<"INFO: predicted "<<npredicted<<" of "<<npoints<<" points"<<endl;
+  return true;
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  if(!cmdline.present("-db")){
+    cerr<<"Usage: cost_predict -db (cost database) [-k (4)] [-margin (1.5)] (monojet.exe options)"<<endl
+        <<"       cost_predict -db (cost database) [-k (4)] -grid (grid) [-o (output)]"<<endl;
+    return 1;
+  }
+
+  CostModel model;
+  if(!model.read(cmdline.value<string>("-db")))
+    return 1;
+  int k = cmdline.value<int>("-k", 4);
+  cout<<"INFO: "<<model.records.size()<<" runs in the cost database"<<endl;
+
+  if(cmdline.present("-grid")){
+    string grid = cmdline.value<string>("-grid");
+    string output = cmdline.value<string>("-o", grid);
+
+    // written aside first, the output may be the grid itself
+    ostringstream sized;
+    if(!size_grid(model, k, grid, sized))
+      return 1;
+    ofstream fout(output.c_str());
+    fout << sized.str();
+    if(!fout.good()){
+      cerr<<"ERROR: cannot write "<<output<<endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  CostRecord point;
+  double cost = model.run_cost(cmdline, point, k);
+  if(cost < 0){
+    cerr<<"ERROR: no run of mode "<<point.mode<<" in the cost database"<<endl;
+    return 1;
+  }
+
+  cout<<"INFO: "<<point.str()<<endl;
+  cout<<"INFO: "<<long(point.get("nevt"))<<" tried events, "
+      <<cost<<" core-seconds"<<endl;
+
+  // the workers of -procs share the events, each its own memory
+  double margin = cmdline.value<double>("-margin", 1.5);
+  int procs = cmdline.value<int>("-procs", 1);
+  long wall = long(ceil(margin*(point.get("init_sec") +
+                                (cost - point.get("init_sec"))/procs)));
+  long mem = long(ceil(margin*procs*point.get("rss_mb")));
+
+  char time[32];
+  snprintf(time, sizeof(time), "%02ld:%02ld:%02ld", wall/3600, wall/60%60, wall%60);
+  cout<<"resources time="<<time<<" mem="<<mem<<"mb cost="<<long(ceil(cost))<<endl;
+  return 0;
+}
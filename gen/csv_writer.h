@@ -0,0 +1,232 @@
+#ifndef __csv_writer_h
+#define __csv_writer_h
+
+// Buffered CSV output for the .evt files
+//
+// ofstream formats every field through the stream locale and the rows
+// used to end in endl, one write per accepted event.  CsvWriter formats
+// numbers into a large buffer, without locale, and writes it in chunks
+// of CSV_WRITER_BUFFER bytes.  Its default format, g6, writes exactly
+// what ofstream did (printf %.6g, the stream default); -evt_format picks
+// another one:
+//
+//   gN         N significant digits, printf %.Ng
+//   fN         N digits after the point, printf %.Nf
+//   shortest   the shortest text that reads back to the same double
+//
+// Numbers go through std::to_chars when the library has it for doubles,
+// through snprintf otherwise; both give the same text.  For shortest,
+// the fallback finds the fewest significant digits that read back to
+// the number and, like to_chars, writes them in %f or %e style,
+// whichever is shorter, %f on a tie.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+using namespace std;
+
+#define CSV_WRITER_BUFFER (4 << 20)
+
+class CsvWriter {
+
+public:
+
+  enum Format {FORMAT_G, FORMAT_FIXED, FORMAT_SHORTEST};
+
+  CsvWriter(): fd(-1), failed(false), format(FORMAT_G), precision(6), used(0) {}
+  ~CsvWriter(){close();}
+
+  // "g6", "f3", "shortest"; false if not one of these
+  bool set_format(const string& name){
+    if(name == "shortest"){
+      format = FORMAT_SHORTEST;
+      return true;
+    }
+    char* end;
+    long digits = name.size() > 1 ? strtol(name.c_str() + 1, &end, 10) : -1;
+    if((name[0] != 'g' && name[0] != 'f') || digits < 0 || digits > 17 || *end){
+      cerr<<"ERROR: unknown number format "<<name<<", use gN, fN or shortest"<<endl;
+      return false;
+    }
+    format = name[0] == 'g' ? FORMAT_G : FORMAT_FIXED;
+    precision = digits;
+    return true;
+  }
+
+  void open(const char* fname){
+    close();
+    fd = ::open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    failed = fd < 0;
+  }
+
+  bool is_open() const {return fd >= 0;}
+  bool good() const {return !failed;}
+
+  void flush(){
+    const char* p = buffer.data();
+    while(used > 0 && !failed){
+      ssize_t n = fd >= 0 ? ::write(fd, p, used) : -1;
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0){
+        failed = true;
+        break;
+      }
+      p += n;
+      used -= n;
+    }
+    used = 0;
+  }
+
+  void close(){
+    flush();
+    if(fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  CsvWriter& operator<<(const string& s){
+    append(s.data(), s.size());
+    return *this;
+  }
+
+  CsvWriter& operator<<(const char* s){
+    append(s, strlen(s));
+    return *this;
+  }
+
+  CsvWriter& operator<<(char c){
+    reserve(1);
+    buffer[used++] = c;
+    return *this;
+  }
+
+  CsvWriter& operator<<(long x){
+    reserve(24);
+    char* out = buffer.data() + used;
+    unsigned long u = x;
+    if(x < 0){
+      *out++ = '-';
+      u = 0UL - u;
+    }
+    char digits[24];
+    int n = 0;
+    do digits[n++] = '0' + u % 10; while((u /= 10) > 0);
+    while(n > 0)
+      *out++ = digits[--n];
+    used = out - buffer.data();
+    return *this;
+  }
+
+  CsvWriter& operator<<(int x){return *this << long(x);}
+
+  CsvWriter& operator<<(double x){
+    // %.17f of 1e308 has 309 digits before the point
+    reserve(352);
+    char* out = buffer.data() + used;
+    used += format_double(out, out + 352, x);
+    return *this;
+  }
+
+private:
+
+  int fd;
+  bool failed;
+  Format format;
+  int precision;
+  vector<char> buffer;
+  size_t used;
+
+  CsvWriter(const CsvWriter&);
+
+  // the buffer is allocated on first use, -noevt writers never need it
+  void reserve(size_t n){
+    if(buffer.empty())
+      buffer.resize(CSV_WRITER_BUFFER);
+    if(used + n > buffer.size())
+      flush();
+  }
+
+  void append(const char* s, size_t n){
+    if(n > CSV_WRITER_BUFFER/2){
+      flush();
+      while(n > 0 && fd >= 0 && !failed){
+        ssize_t w = ::write(fd, s, n);
+        if(w < 0 && errno == EINTR)
+          continue;
+        if(w <= 0)
+          failed = true;
+        else {
+          s += w;
+          n -= w;
+        }
+      }
+      return;
+    }
+    reserve(n);
+    memcpy(buffer.data() + used, s, n);
+    used += n;
+  }
+
+  size_t format_double(char* out, char* end, double x) const {
+#if defined(__cpp_lib_to_chars)
+    to_chars_result r;
+    if(format == FORMAT_SHORTEST)
+      r = to_chars(out, end, x);
+    else
+      r = to_chars(out, end, x, format == FORMAT_G ? chars_format::general
+                   : chars_format::fixed, precision);
+    return r.ptr - out;
+#else
+    int n;
+    if(format == FORMAT_SHORTEST)
+      n = shortest(out, end - out, x);
+    else
+      n = snprintf(out, end - out, format == FORMAT_G ? "%.*g" : "%.*f", precision, x);
+    return n > 0 ? min(size_t(n), size_t(end - out - 1)) : 0;
+#endif
+  }
+
+#if !defined(__cpp_lib_to_chars)
+  // Fewest significant digits that read back to x, in the shorter of
+  // %f and %e style, as to_chars(out, end, x) writes them
+  static int shortest(char* out, size_t size, double x){
+    if(!std::isfinite(x) || x == 0)
+      return snprintf(out, size, "%g", x);
+
+    char sci[32];
+    int digits = 1;
+    for(; digits<17; ++digits){
+      snprintf(sci, sizeof(sci), "%.*e", digits - 1, x);
+      if(strtod(sci, NULL) == x)
+        break;
+    }
+    snprintf(sci, sizeof(sci), "%.*e", digits - 1, x);
+
+    // the same digits without an exponent
+    int exponent = atoi(strchr(sci, 'e') + 1);
+    char fixed[400];
+    snprintf(fixed, sizeof(fixed), "%.*f", max(0, digits - 1 - exponent), x);
+
+    const char* best = strlen(fixed) <= strlen(sci) ? fixed : sci;
+    return snprintf(out, size, "%s", best);
+  }
+#endif
+};
+
+#endif
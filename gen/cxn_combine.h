@@ -0,0 +1,44 @@
+#ifndef __cxn_combine_h
+#define __cxn_combine_h
+
+// Combination of the cross-section estimates (sigmaGen +- sigmaErr)
+// of independent runs of the same process: weighted by the inverse
+// variance, falling back to weighting by the number of events when
+// no errors are available.
+
+#include <cmath>
+
+class CxnCombiner {
+
+public:
+
+  CxnCombiner(): sum_inv_var(0), sum_cxn_inv_var(0), sum_n(0), sum_cxn_n(0) {}
+
+  void add(double cxn, double err, double nevt){
+    if(err > 0){
+      sum_inv_var += 1/(err*err);
+      sum_cxn_inv_var += cxn/(err*err);
+    }
+    sum_n += nevt;
+    sum_cxn_n += cxn*nevt;
+  }
+
+  bool empty() const {return sum_inv_var <= 0 && sum_n <= 0;}
+
+  double cxn() const {
+    if(sum_inv_var > 0)
+      return sum_cxn_inv_var/sum_inv_var;
+    return sum_n > 0 ? sum_cxn_n/sum_n : 0;
+  }
+
+  double err() const {
+    return sum_inv_var > 0 ? 1/std::sqrt(sum_inv_var) : 0;
+  }
+
+private:
+
+  double sum_inv_var, sum_cxn_inv_var;
+  double sum_n, sum_cxn_n;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef __delphes_prune_h
+#define __delphes_prune_h
+
+// Pruning of a Delphes card to the modules the selection needs
+//
+// Every module reads its inputs from "<Module>/<array>" parameters whose
+// name ends in InputArray.  Starting from the arrays fill_reco_event
+// imports, the modules they come from and, recursively, the modules
+// those read from make up the minimal set; the rest of the card's
+// ExecutionPath is dropped.  Modules without output arrays (b- and
+// tau-tagging, flavour association) modify their inputs in place, so
+// they are kept whenever they read a needed array.  The card is rewritten with the pruned
+// path, in the original order, and read from a temporary copy.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+using namespace std;
+
+class CardPruner {
+
+public:
+
+  vector<string> path;                    // ExecutionPath of the card
+  map<string, vector<string> > inputs;    // module -> input arrays
+  set<string> producers;                  // modules with output arrays
+  vector<string> kept, dropped;
+
+  CardPruner(): path_begin(-1), path_end(-1) {}
+
+  bool read(const string& card){
+    ifstream fin(card.c_str());
+    if(!fin.good()){
+      cerr<<"ERROR: cannot read detector card "<<card<<endl;
+      return false;
+    }
+
+    path.clear();
+    inputs.clear();
+    producers.clear();
+    lines.clear();
+    path_begin = path_end = -1;
+
+    string line, module;
+    int depth = 0;
+    while(getline(fin, line)){
+      lines.push_back(line);
+
+      istringstream sin(line);
+      string word;
+      vector<string> words;
+      while(sin >> word)
+        words.push_back(word);
+
+      bool comment = !words.empty() && words[0][0] == '#';
+      int start_depth = depth;
+      if(!comment)
+        for(size_t i=0; i<line.size(); ++i){
+          if(line[i] == '{') ++depth;
+          else if(line[i] == '}') --depth;
+        }
+      if(comment || words.empty())
+        continue;
+
+      if(path_begin >= 0 && path_end < 0){
+        for(size_t i=0; i<words.size(); ++i)
+          if(words[i] != "}")
+            path.push_back(words[i]);
+        if(depth == 0)
+          path_end = lines.size() - 1;
+      }
+      else if(start_depth == 0 && words.size() >= 2 && words[0] == "set" &&
+              words[1] == "ExecutionPath"){
+        path_begin = lines.size() - 1;
+        for(size_t i=2; i<words.size(); ++i)
+          if(words[i] != "{" && words[i] != "}")
+            path.push_back(words[i]);
+        if(depth == 0)
+          path_end = path_begin;
+      }
+      else if(start_depth == 0 && words.size() >= 3 && words[0] == "module")
+        module = words[2];
+      else if(start_depth == 1 && words.size() >= 3 &&
+              (words[0] == "set" || words[0] == "add")){
+        if(ends_with(words[1], "InputArray"))
+          inputs[module].push_back(words[2]);
+        else if(ends_with(words[1], "OutputArray"))
+          producers.insert(module);
+      }
+    }
+
+    if(path_begin < 0 || path_end < 0){
+      cerr<<"ERROR: no ExecutionPath in "<<card<<endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Keep the modules producing arrays ("Module/array"), directly or
+  // through their inputs
+  void prune(const vector<string>& arrays){
+    set<string> needed;
+    vector<string> todo;
+    for(size_t i=0; i<arrays.size(); ++i)
+      todo.push_back(array_module(arrays[i]));
+
+    while(!todo.empty()){
+      while(!todo.empty()){
+        string module = todo.back();
+        todo.pop_back();
+        if(module == "Delphes" || !needed.insert(module).second)
+          continue;
+        const vector<string>& in = inputs[module];
+        for(size_t i=0; i<in.size(); ++i)
+          todo.push_back(array_module(in[i]));
+      }
+
+      // in-place modules acting on needed arrays
+      for(size_t i=0; i<path.size(); ++i){
+        const string& module = path[i];
+        if(needed.count(module) || producers.count(module))
+          continue;
+        const vector<string>& in = inputs[module];
+        for(size_t j=0; j<in.size(); ++j)
+          if(needed.count(array_module(in[j]))){
+            todo.push_back(module);
+            break;
+          }
+      }
+    }
+
+    kept.clear();
+    dropped.clear();
+    for(size_t i=0; i<path.size(); ++i)
+      (needed.count(path[i]) ? kept : dropped).push_back(path[i]);
+
+    for(set<string>::const_iterator it=needed.begin(); it!=needed.end(); ++it)
+      if(find(path.begin(), path.end(), *it) == path.end())
+        cerr<<"WARNING: module "<<*it<<" is needed but not in the ExecutionPath"<<endl;
+  }
+
+  void print(ostream& out, const string& tag) const {
+    out<<"INFO: "<<tag<<": running "<<kept.size()<<" of "<<path.size()
+       <<" modules, dropping";
+    if(dropped.empty())
+      out<<" none";
+    for(size_t i=0; i<dropped.size(); ++i)
+      out<<" "<<dropped[i];
+    out<<endl;
+  }
+
+  // The card with the pruned ExecutionPath, written to a temporary
+  // file; returns its name, empty on error
+  string write_temporary() const {
+    char name[] = "/tmp/delphes_card_XXXXXX";
+    int fd = mkstemp(name);
+    if(fd < 0){
+      cerr<<"ERROR: cannot write the pruned detector card"<<endl;
+      return "";
+    }
+    close(fd);
+
+    ofstream fout(name);
+    for(int i=0; i<int(lines.size()); ++i){
+      if(i == path_begin){
+        fout<<"set ExecutionPath {"<<endl;
+        for(size_t j=0; j<kept.size(); ++j)
+          fout<<"  "<<kept[j]<<endl;
+        fout<<"}"<<endl;
+      }
+      if(i < path_begin || i > path_end)
+        fout<<lines[i]<<endl;
+    }
+    if(!fout.good()){
+      cerr<<"ERROR: cannot write the pruned detector card"<<endl;
+      remove(name);
+      return "";
+    }
+    return name;
+  }
+
+private:
+
+  vector<string> lines;
+  int path_begin, path_end;   // lines of the ExecutionPath
+
+  static bool ends_with(const string& s, const string& end){
+    return s.size() >= end.size() &&
+      s.compare(s.size() - end.size(), end.size(), end) == 0;
+  }
+
+  static string array_module(const string& array){
+    return array.substr(0, array.find('/'));
+  }
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef __detectors_h
+#define __detectors_h
+
+// Several detector simulations of the same generated events
+// (-detector CMS,ATLAS)
+//
+// Each card gets its own Delphes instance, fed the same particles, and
+// its own selection outputs <output>_<tag>.evt, .meta, .hist.json and
+// .objs, where <tag> is the card name without delphes_card_ and .tcl.
+// With a single card the outputs keep their plain names.
+//
+// "none" is a truth-level detector: no Delphes, jets are clustered
+// from the generated visible particles and MET is the sum of the
+// invisible ones (fill_truth_event); its outputs are tagged "truth".
+//
+// All Delphes modules draw from ROOT's gRandom, so the detectors share
+// one random stream: adding a card changes the smearing of the others.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// Delphes library
+#include "modules/Delphes.h"
+#include "classes/DelphesClasses.h"
+#include "classes/DelphesFactory.h"
+
+#include "fastjet/ClusterSequence.hh"
+
+#include "csv_writer.h"
+#include "event_stream.h"
+#include "histograms.h"
+#include "object_store.h"
+#include "delphes_prune.h"
+
+using namespace std;
+using namespace fastjet;
+
+struct Detector {
+  string card, tag;
+  string output;       // base name of the outputs
+
+  ExRootConfReader* config;
+  Delphes* delphes;
+  DelphesFactory* factory;
+  TObjArray* stable;   // input particles
+
+  // truth level, without Delphes
+  JetDefinition truth_jet_def;
+  double truth_jet_ptmin;      // JetPTMin of the shipped cards
+
+  // selection outputs
+  CsvWriter file_evt;
+  EventStream stream;  // -stream
+  HistogramSet hists;
+  ObjectStoreWriter store;
+  long n_pass;
+
+  Detector(): config(NULL), delphes(NULL), factory(NULL), stable(NULL),
+    truth_jet_def(antikt_algorithm, 0.5), truth_jet_ptmin(20), n_pass(0) {}
+
+  bool truth() const {return delphes == NULL;}
+};
+
+// "CMS" -> delphes_card_CMS.tcl, names ending in .tcl are paths
+string detector_card(const string& name){
+  if(name.size() > 4 && name.substr(name.size() - 4) == ".tcl")
+    return name;
+  return "delphes_card_" + name + ".tcl";
+}
+
+// delphes_card_CMS.tcl -> CMS
+string detector_tag(const string& card){
+  string tag = card;
+  size_t slash = tag.rfind('/');
+  if(slash != string::npos)
+    tag = tag.substr(slash + 1);
+  if(tag.size() > 4 && tag.substr(tag.size() - 4) == ".tcl")
+    tag = tag.substr(0, tag.size() - 4);
+  if(tag.compare(0, 13, "delphes_card_") == 0 && tag.size() > 13)
+    tag = tag.substr(13);
+  return tag;
+}
+
+// Read the cards of a comma separated list and set up one Delphes per
+// card; InitTask is left to the caller, once the ROOT application
+// exists.  Unless arrays is empty, each card only runs the modules
+// needed for those arrays.
+bool setup_detectors(const string& list, const string& output,
+                     const vector<string>& arrays,
+                     vector<Detector*>& detectors){
+  stringstream sin(list);
+  string name;
+  while(getline(sin, name, ',')){
+    if(name.empty())
+      continue;
+
+    Detector* det = new Detector();
+    if(name == "none")
+      det->tag = "truth";
+    else {
+      det->card = detector_card(name);
+      det->tag = detector_tag(det->card);
+    }
+
+    for(size_t i=0; i<detectors.size(); ++i)
+      if(detectors[i]->tag == det->tag){
+        cerr<<"ERROR: detector "<<det->tag<<" given twice"<<endl;
+        return false;
+      }
+
+    if(det->truth()){
+      detectors.push_back(det);
+      continue;
+    }
+
+    if(!ifstream(det->card.c_str()).good()){
+      cerr<<"ERROR: cannot read detector card "<<det->card<<endl;
+      return false;
+    }
+
+    det->config = new ExRootConfReader();
+    if(arrays.empty())
+      det->config->ReadFile(det->card.c_str());
+    else {
+      CardPruner pruner;
+      if(!pruner.read(det->card))
+        return false;
+      pruner.prune(arrays);
+      pruner.print(cout, det->tag);
+
+      string pruned = pruner.write_temporary();
+      if(pruned.empty())
+        return false;
+      det->config->ReadFile(pruned.c_str());
+      remove(pruned.c_str());
+    }
+
+    // distinct names, Delphes registers its folder by name
+    det->delphes = new Delphes(("Delphes_" + det->tag).c_str());
+    det->delphes->SetConfReader(det->config);
+    det->factory = det->delphes->GetFactory();
+    det->stable = det->delphes->ExportArray("stableParticles");
+
+    detectors.push_back(det);
+  }
+
+  if(detectors.empty()){
+    cerr<<"ERROR: no detector card in "<<list<<endl;
+    return false;
+  }
+
+  for(size_t i=0; i<detectors.size(); ++i){
+    Detector* det = detectors[i];
+    det->output = detectors.size() > 1 ? output + "_" + det->tag : output;
+    if(det->truth())
+      cout<<"INFO: truth-level detector, output "<<det->output<<endl;
+    else
+      cout<<"INFO: detector "<<det->tag<<" from "<<det->card
+          <<", output "<<det->output<<endl;
+  }
+  return true;
+}
+
+#endif
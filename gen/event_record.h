@@ -0,0 +1,341 @@
+#ifndef __event_record_h
+#define __event_record_h
+
+// Compact per-event records handed between the stages of the event
+// processing (generation -> detector -> selection), and the monojet
+// selection itself working on the reconstructed record.
+
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+#include "fastjet/ClusterSequence.hh"
+
+// Delphes library
+#include "modules/Delphes.h"
+#include "classes/DelphesClasses.h"
+#include "classes/DelphesFactory.h"
+
+#include "Pythia8/Pythia.h"
+
+#include "pythia_functions.h"
+#include "selection.h"
+#include "object_store.h"
+
+using namespace std;
+using namespace fastjet;
+
+// Visible final-state particle, as fed to Delphes
+struct GenParticle {
+  int pid;
+  int status;
+  double charge, mass;
+  double px, py, pz, e;
+};
+
+// Generator output for one event
+struct GenRecord {
+  long id;
+  double weight;
+  int n_meson, n_glu;
+  vector<GenParticle> particles;
+  // sum of the invisible final-state particles (truth MET)
+  double inv_px, inv_py;
+  // generator and its running cross section estimate (mb)
+  int igen;
+  double sigma_gen, sigma_err;
+  // events of the generator over budget before this one
+  int n_over;
+  // failed Pythia next() calls of the generator so far
+  int n_failed;
+  // set on the last record of a generator
+  bool last;
+
+  GenRecord(): id(0), weight(1), n_meson(0), n_glu(0), inv_px(0), inv_py(0),
+    igen(0), sigma_gen(0), sigma_err(0), n_over(0), n_failed(0), last(false) {}
+};
+
+// Reconstructed object, with pT and eta as Delphes computed them,
+// and the substructure Delphes fills for jets
+struct RecoObject {
+  double px, py, pz, e;
+  double pt, eta, phi, mass;
+  double charge;
+
+  float tau[3];          // N-subjettiness
+  int ncharged, nneutral;
+  int btag, tautag;
+
+  RecoObject(): px(0), py(0), pz(0), e(0), pt(0), eta(0), phi(0), mass(0),
+    charge(0), ncharged(0), nneutral(0), btag(0), tautag(0) {
+    tau[0] = tau[1] = tau[2] = 0;
+  }
+
+  RecoObject(const Candidate* can){
+    const TLorentzVector& p = can->Momentum;
+    px = p.Px(); py = p.Py(); pz = p.Pz(); e = p.E();
+    pt = p.Pt(); eta = p.Eta(); phi = p.Phi(); mass = p.M();
+    charge = can->Charge;
+    for(int i=0; i<3; ++i)
+      tau[i] = can->Tau[i];
+    ncharged = can->NCharged;
+    nneutral = can->NNeutrals;
+    btag = can->BTag;
+    tautag = can->TauTag;
+  }
+
+  // truth jet, without substructure
+  RecoObject(const PseudoJet& jet): px(jet.px()), py(jet.py()), pz(jet.pz()),
+    e(jet.e()), pt(jet.pt()), eta(jet.eta()), phi(jet.phi_std()), mass(jet.m()),
+    charge(0), ncharged(0), nneutral(0), btag(0), tautag(0) {
+    tau[0] = tau[1] = tau[2] = 0;
+  }
+
+  PseudoJet pseudojet() const {return PseudoJet(px, py, pz, e);}
+};
+
+// Detector output for one event
+struct RecoEvent {
+  long id;
+  double weight;
+  int n_meson, n_glu;
+
+  // false if Delphes gave no MissingET
+  bool has_met;
+  double met_px, met_py, met;
+
+  vector<RecoObject> jets, muons, electrons;
+
+  RecoEvent(): id(0), weight(1), n_meson(0), n_glu(0), has_met(false),
+    met_px(0), met_py(0), met(0) {}
+
+  void clear(){
+    has_met = false;
+    jets.clear();
+    muons.clear();
+    electrons.clear();
+  }
+};
+
+// One generated event as seen by each detector
+struct RecoSet {
+  vector<RecoEvent> detectors;
+  // as in the GenRecord
+  int igen;
+  double sigma_gen, sigma_err;
+  int n_over, n_failed;
+  // marks the end of the run
+  bool last;
+
+  RecoSet(): igen(0), sigma_gen(0), sigma_err(0), n_over(0), n_failed(0), last(false) {}
+};
+
+
+// Copy the particles Pythia_to_Delphes would use, and sum up the
+// invisible ones
+void fill_gen_record(const Pythia8::Event& evt, GenRecord& rec){
+  rec.particles.clear();
+  rec.inv_px = rec.inv_py = 0;
+  for(int i=0; i<evt.size(); ++i){
+    const Pythia8::Particle& p = evt[i];
+    if((p.statusHepMC()) != 1)
+      continue;
+    if(!p.isVisible()){
+      rec.inv_px += p.px();
+      rec.inv_py += p.py();
+      continue;
+    }
+    GenParticle gp;
+    gp.pid = p.id();
+    gp.status = p.statusHepMC();
+    gp.charge = p.charge();
+    gp.mass = p.m();
+    gp.px = p.px(); gp.py = p.py(); gp.pz = p.pz(); gp.e = p.e();
+    rec.particles.push_back(gp);
+  }
+}
+
+// Same as Pythia_to_Delphes, from a generator record
+void GenRecord_to_Delphes(DelphesFactory* factory, TObjArray* ary,
+                          const GenRecord& rec){
+  for(size_t i=0; i<rec.particles.size(); ++i){
+    const GenParticle& p = rec.particles[i];
+    Candidate* can = factory->NewCandidate();
+    can->PID = p.pid;
+    can->Status = p.status;
+    can->Charge = p.charge;
+    can->Mass = p.mass;
+    can->Momentum.SetPxPyPzE(p.px, p.py, p.pz, p.e);
+    ary->Add(can);
+  }
+}
+
+// Truth-level objects (-detector none): jets clustered from the
+// visible final-state particles, MET from the invisible ones (dark
+// mesons 4900211/4900213 and neutrinos) with the sign of Delphes'
+// MissingET, and no leptons.  particles is scratch space.
+void fill_truth_event(const GenRecord& rec, const JetDefinition& jet_def,
+                      double jet_ptmin, vector<PseudoJet>& particles,
+                      RecoEvent& reco){
+  reco.clear();
+
+  particles.clear();
+  for(size_t i=0; i<rec.particles.size(); ++i){
+    const GenParticle& p = rec.particles[i];
+    particles.push_back(PseudoJet(p.px, p.py, p.pz, p.e));
+  }
+
+  ClusterSequence cs(particles, jet_def);
+  vector<PseudoJet> jets = sorted_by_pt(cs.inclusive_jets(jet_ptmin));
+  for(size_t i=0; i<jets.size(); ++i)
+    reco.jets.push_back(RecoObject(jets[i]));
+
+  reco.has_met = true;
+  reco.met_px = rec.inv_px;
+  reco.met_py = rec.inv_py;
+  reco.met = sqrt(rec.inv_px*rec.inv_px + rec.inv_py*rec.inv_py);
+}
+
+// Delphes arrays fill_reco_event reads, all other modules of a card
+// can be skipped
+vector<string> reco_event_arrays(){
+  const char* arrays[] = {"MissingET/momentum", "UniqueObjectFinder/jets",
+                          "UniqueObjectFinder/muons", "UniqueObjectFinder/electrons"};
+  return vector<string>(arrays, arrays + 4);
+}
+
+// Read back the objects the selection needs after ProcessTask
+void fill_reco_event(Delphes* delphes, RecoEvent& reco){
+  reco.clear();
+
+  // At(0) rather than a TIter, which would allocate every event
+  const TObjArray* vMEt = delphes->ImportArray("MissingET/momentum");
+  Candidate* can = vMEt->GetEntriesFast() > 0 ? (Candidate*) vMEt->At(0) : NULL;
+  if(can != NULL){
+    reco.has_met = true;
+    reco.met_px = can->Momentum.Px();
+    reco.met_py = can->Momentum.Py();
+    reco.met = can->Momentum.Pt();
+  }
+
+  const TObjArray* jets = delphes->ImportArray("UniqueObjectFinder/jets");
+  const TObjArray* muons = delphes->ImportArray("UniqueObjectFinder/muons");
+  const TObjArray* electrons = delphes->ImportArray("UniqueObjectFinder/electrons");
+
+  for(int i=0; i<jets->GetEntriesFast(); i++)
+    reco.jets.push_back(RecoObject((Candidate*) jets->At(i)));
+  for(int i=0; i<muons->GetEntriesFast(); i++)
+    reco.muons.push_back(RecoObject((Candidate*) muons->At(i)));
+  for(int i=0; i<electrons->GetEntriesFast(); i++)
+    reco.electrons.push_back(RecoObject((Candidate*) electrons->At(i)));
+}
+
+
+// Append all reconstructed objects of an event to the store
+bool store_reco_event(ObjectStoreWriter& store, const RecoEvent& reco){
+  StoreBlock& block = store.block;
+  for(size_t i=0; i<reco.jets.size(); ++i){
+    const RecoObject& j = reco.jets[i];
+    block.add_jet(j.pt, j.eta, j.phi, j.mass, j.tau,
+                  j.ncharged, j.nneutral, j.btag, j.tautag);
+  }
+  for(size_t i=0; i<reco.muons.size(); ++i){
+    const RecoObject& l = reco.muons[i];
+    StoreBlock::add_lepton(block.muons, l.pt, l.eta, l.phi, l.charge);
+  }
+  for(size_t i=0; i<reco.electrons.size(); ++i){
+    const RecoObject& l = reco.electrons[i];
+    StoreBlock::add_lepton(block.electrons, l.pt, l.eta, l.phi, l.charge);
+  }
+  block.end_event(reco.weight, reco.met_px, reco.met_py,
+                  reco.has_met ? reco.met : -1, reco.n_meson, reco.n_glu);
+  return store.commit();
+}
+
+// Apply the monojet selection; fills the kinematic columns of row
+// (evt, n_meson and n_glu are left to the caller).  selected_jets is
+// scratch space, kept by the caller so that it is reused every event.
+bool select_event(const RecoEvent& reco, const SelectionCuts& cuts,
+                  EvtRow& row, vector<PseudoJet>& selected_jets){
+
+  // Missing ET pointer must exist
+  if(!reco.has_met){
+    cout<<"ERROR: MET pointer not found!"<<endl;
+    return false;
+  }
+  // If met is too small or large, reject
+  if((reco.met < cuts.met_min) || (reco.met > cuts.met_max))
+    return false;
+
+  PseudoJet MEt(-reco.met_px, -reco.met_py, 0, reco.met);
+
+  // Lepton veto
+  if(cuts.lepton_veto){
+    for(size_t i=0; i<reco.muons.size(); i++)
+      if(fabs(reco.muons[i].eta) <= cuts.muon_eta &&
+         fabs(reco.muons[i].pt) >= cuts.muon_pt)
+        return false;
+    for(size_t i=0; i<reco.electrons.size(); i++)
+      if(fabs(reco.electrons[i].eta) <= cuts.electron_eta &&
+         fabs(reco.electrons[i].pt) >= cuts.electron_pt)
+        return false;
+  }
+
+  selected_jets.clear();
+  for(size_t i=0; i<reco.jets.size(); i++){
+    const RecoObject& jet = reco.jets[i];
+    if(jet.pt < cuts.jet_pt)
+      continue;
+    if(fabs(jet.eta) > cuts.jet_eta)
+      continue;
+    selected_jets.push_back(jet.pseudojet());
+  }
+
+  double mjj = 0;
+  if(selected_jets.size() >= 2)
+    mjj = (selected_jets[0]+selected_jets[1]).m();
+
+  //if Zprime mode, recluster into R=1.1 jets
+  if(cuts.Zprime){
+    JetDefinition jet_def(cambridge_algorithm, 1.1);
+    ClusterSequence cs(selected_jets, jet_def);
+    selected_jets = sorted_by_pt(cs.inclusive_jets());
+  }
+
+  //demand njets > pt_min
+  if(int(selected_jets.size()) < cuts.njet || selected_jets[0].pt() < cuts.pt_min ||
+     int(selected_jets.size()) > cuts.njet_max)
+    return false;
+
+  double dphijj = get_dphijj(MEt, selected_jets);
+  if(dphijj < cuts.dphi_min)
+    return false;
+
+  row.v[EvtRow::MEt] = MEt.pt();
+  row.v[EvtRow::mjj] = mjj;
+  row.v[EvtRow::Mt] = 0;
+  if(selected_jets.size() >= 2)
+    row.v[EvtRow::Mt] = (MEt+selected_jets[0]+selected_jets[1]).mperp();
+
+  for(int i=0; i<4; i++){
+    double* col = &row.v[EvtRow::pt1 + 3*i];
+    if(int(selected_jets.size()) > i){
+      col[0] = selected_jets[i].pt();
+      col[1] = selected_jets[i].eta();
+      col[2] = selected_jets[i].rap();
+    }
+    else{
+      col[0] = -1;
+      col[1] = 999;
+      col[2] = 0;
+    }
+  }
+
+  row.v[EvtRow::dphi] = dphijj;
+  row.v[EvtRow::nj] = selected_jets.size();
+  row.weight = reco.weight;
+  return true;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef __event_stream_h
+#define __event_stream_h
+
+// Accepted events published in a POSIX shared-memory ring (-stream name)
+//
+// monojet.exe writes every accepted .evt row, plus its weight, into the
+// shared memory object /name (one per detector, with the suffix of its
+// outputs), where any number of local processes can read them while the
+// run goes on.  The layout, in native byte order, is
+//
+//   StreamHeader    magic "MJSTRM01" (written last), ncol, policy,
+//                   capacity (slots, a power of 2), slot_bytes,
+//                   column names (STREAM_NAME_BYTES each), write_seq,
+//                   closed, and the table of attached readers
+//   slots           capacity x (uint64 seq, ncol x float64)
+//
+// Record s (0, 1, ...) goes to slot s % capacity.  The writer marks the
+// slot 2s+1 while it writes and 2s+2 once the record is complete, then
+// sets write_seq to s+1.  A reader checks that the slot still holds
+// 2s+2 after reading it; anything else means the record was
+// overwritten.  Policies:
+//
+//   overwrite   the writer never waits; slow readers lose the oldest
+//               records and count them
+//   block       the writer waits for the slowest attached reader, so
+//               nothing is lost; readers get the records in place,
+//               without a copy, valid until their next call
+//
+// Readers register their pid and read position in the header; the
+// writer drops readers whose process is gone.  Closing the writer sets
+// closed and unlinks the name; attached readers drain what is left.
+// Old glibc needs -lrt for shm_open.
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shutdown.h"
+
+using namespace std;
+
+#define STREAM_MAX_COLUMNS 64
+#define STREAM_NAME_BYTES 32
+#define STREAM_MAX_READERS 16
+
+static const char stream_magic[] = "MJSTRM01";
+
+enum StreamPolicy {STREAM_OVERWRITE, STREAM_BLOCK};
+
+struct StreamReaderSlot {
+  atomic<int32_t> pid;           // 0: free, -1: being claimed
+  atomic<uint64_t> read_seq;     // records before this one are done with
+  char pad[48];
+};
+
+struct StreamHeader {
+  char magic[8];
+  uint32_t ncol, policy;
+  uint64_t capacity;
+  uint64_t slot_bytes;
+  char names[STREAM_MAX_COLUMNS][STREAM_NAME_BYTES];
+  alignas(64) atomic<uint64_t> write_seq;
+  alignas(64) atomic<uint32_t> closed;
+  alignas(64) StreamReaderSlot readers[STREAM_MAX_READERS];
+};
+
+struct StreamSlot {
+  atomic<uint64_t> seq;
+  double values[1];              // ncol of them
+};
+
+// "name" and "/name" both name /name
+string stream_shm_name(const string& name){
+  return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+size_t stream_slots_offset(){
+  return (sizeof(StreamHeader) + 63)/64*64;
+}
+
+// Common part of the writer and the readers: the mapping
+class StreamMapping {
+
+public:
+
+  StreamHeader* header;
+
+  StreamMapping(): header(NULL), bytes(0) {}
+
+  StreamSlot* slot(uint64_t seq) const {
+    return (StreamSlot*) ((char*) header + stream_slots_offset() +
+                          (seq & (header->capacity - 1))*header->slot_bytes);
+  }
+
+  vector<string> columns() const {
+    vector<string> names;
+    for(uint32_t c=0; header && c<header->ncol; ++c)
+      names.push_back(string(header->names[c], strnlen(header->names[c], STREAM_NAME_BYTES)));
+    return names;
+  }
+
+protected:
+
+  size_t bytes;
+
+  bool map(int fd, size_t n){
+    void* ptr = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(ptr == MAP_FAILED)
+      return false;
+    header = (StreamHeader*) ptr;
+    bytes = n;
+    return true;
+  }
+
+  void unmap(){
+    if(header)
+      munmap(header, bytes);
+    header = NULL;
+  }
+};
+
+class EventStream : public StreamMapping {
+
+public:
+
+  string name;
+
+  EventStream() {}
+  ~EventStream(){close();}
+
+  bool is_open() const {return header != NULL;}
+
+  // A new ring for the columns, replacing one left by an earlier run
+  bool create(const string& stream_name, const vector<string>& columns,
+              long capacity, int policy){
+    name = stream_shm_name(stream_name);
+    if(columns.size() > STREAM_MAX_COLUMNS){
+      cerr<<"ERROR: at most "<<STREAM_MAX_COLUMNS<<" columns in a stream"<<endl;
+      return false;
+    }
+    uint64_t slots = 1;
+    while(slots < uint64_t(max(2L, capacity)))
+      slots *= 2;
+    size_t slot_bytes = (8 + 8*columns.size() + 7)/8*8;
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    size_t n = stream_slots_offset() + slots*slot_bytes;
+    bool mapped = fd >= 0 && ftruncate(fd, n) == 0 && map(fd, n);
+    if(fd >= 0)
+      ::close(fd);
+    if(!mapped){
+      cerr<<"ERROR: cannot create shared memory "<<name<<": "<<strerror(errno)<<endl;
+      shm_unlink(name.c_str());
+      return false;
+    }
+
+    // ftruncate gives zeros: no readers, no records
+    header->ncol = columns.size();
+    header->policy = policy;
+    header->capacity = slots;
+    header->slot_bytes = slot_bytes;
+    for(size_t c=0; c<columns.size(); ++c)
+      strncpy(header->names[c], columns[c].c_str(), STREAM_NAME_BYTES);
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, stream_magic, 8);
+
+    cout<<"INFO: streaming accepted events to shared memory "<<name<<", "
+        <<slots<<" slots, "<<(policy == STREAM_BLOCK ? "blocking" : "overwriting")<<endl;
+    return true;
+  }
+
+  // The .evt columns, then the weight; false if the record was dropped
+  // because the run is stopping while the writer waits for a reader
+  bool publish(const vector<double>& values, double weight){
+    uint64_t s = header->write_seq.load(memory_order_relaxed);
+    if(header->policy == STREAM_BLOCK)
+      for(int wait=1; s - slowest_reader(s) >= header->capacity; wait=min(2*wait, 1000)){
+        if(stop_requested())
+          return false;
+        usleep(wait);
+      }
+
+    StreamSlot* slot = this->slot(s);
+    slot->seq.store(2*s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    size_t n = min(values.size(), size_t(header->ncol - 1));
+    memcpy(slot->values, values.data(), 8*n);
+    slot->values[n] = weight;
+    slot->seq.store(2*s + 2, memory_order_release);
+    header->write_seq.store(s + 1, memory_order_release);
+    return true;
+  }
+
+  void close(){
+    if(!header)
+      return;
+    header->closed.store(1, memory_order_release);
+    unmap();
+    shm_unlink(name.c_str());
+  }
+
+private:
+
+  EventStream(const EventStream&);
+
+  // Oldest position of the live readers, s without readers
+  uint64_t slowest_reader(uint64_t s){
+    uint64_t slowest = s;
+    for(int r=0; r<STREAM_MAX_READERS; ++r){
+      StreamReaderSlot& reader = header->readers[r];
+      int32_t pid = reader.pid.load(memory_order_acquire);
+      if(pid <= 0)
+        continue;
+      if(kill(pid, 0) != 0 && errno == ESRCH){
+        reader.pid.compare_exchange_strong(pid, 0);
+        continue;
+      }
+      slowest = min(slowest, reader.read_seq.load(memory_order_acquire));
+    }
+    return slowest;
+  }
+};
+
+class EventStreamReader : public StreamMapping {
+
+public:
+
+  long lost;          // records overwritten before they were read
+
+  EventStreamReader(): lost(0), ireader(-1), next_seq(0) {}
+  ~EventStreamReader(){detach();}
+
+  // Attach to a running stream, from its next record or, with
+  // from_oldest, from the oldest one still in the ring
+  bool attach(const string& stream_name, bool from_oldest = false){
+    string name = stream_shm_name(stream_name);
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    struct stat st;
+    bool mapped = fd >= 0 && fstat(fd, &st) == 0 &&
+      size_t(st.st_size) >= stream_slots_offset() && map(fd, st.st_size);
+    if(fd >= 0)
+      ::close(fd);
+    if(!mapped){
+      cerr<<"ERROR: no stream "<<name<<endl;
+      return false;
+    }
+    if(memcmp(header->magic, stream_magic, 8) != 0 ||
+       bytes < stream_slots_offset() + header->capacity*header->slot_bytes){
+      cerr<<"ERROR: "<<name<<" is not an event stream"<<endl;
+      unmap();
+      return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    uint64_t w = header->write_seq.load(memory_order_acquire);
+    next_seq = from_oldest && w > header->capacity ? w - header->capacity : from_oldest ? 0 : w;
+
+    // claim a free entry (pid -1, ignored by the writer), set its
+    // position, then make it count
+    for(int r=0; r<STREAM_MAX_READERS && ireader < 0; ++r){
+      int32_t free_pid = 0;
+      if(header->readers[r].pid.compare_exchange_strong(free_pid, -1)){
+        header->readers[r].read_seq.store(next_seq, memory_order_release);
+        header->readers[r].pid.store(getpid(), memory_order_release);
+        ireader = r;
+      }
+    }
+    if(ireader < 0)
+      cerr<<"WARNING: "<<STREAM_MAX_READERS<<" readers on "<<name
+          <<" already, reading unregistered: a blocking writer will not wait for this one"<<endl;
+    row.resize(header->ncol);
+    return true;
+  }
+
+  // Next record into values, pointing either into the ring (blocking
+  // writer) or to a copy; 1 with a record, 0 after timeout_ms without
+  // one (never with a negative timeout), -1 once the writer has closed
+  // and everything is read
+  int next(const double*& values, int timeout_ms = -1){
+    release(next_seq);
+    for(long waited=0, wait=1; ; waited+=wait, wait=min(2*wait, 1000L)){
+      uint64_t w = header->write_seq.load(memory_order_acquire);
+      if(next_seq < w){
+        if(read_record(w, values))
+          return 1;
+        continue;
+      }
+      if(header->closed.load(memory_order_acquire))
+        return -1;
+      if(timeout_ms >= 0 && waited >= 1000L*timeout_ms)
+        return 0;
+      usleep(wait);
+    }
+  }
+
+  // Sequence number of the record last returned by next
+  uint64_t sequence() const {return next_seq - 1;}
+
+  void detach(){
+    if(header && ireader >= 0)
+      header->readers[ireader].pid.store(0, memory_order_release);
+    ireader = -1;
+    unmap();
+  }
+
+private:
+
+  int ireader;
+  uint64_t next_seq;
+  vector<double> row;
+
+  EventStreamReader(const EventStreamReader&);
+
+  void release(uint64_t seq){
+    if(ireader >= 0)
+      header->readers[ireader].read_seq.store(seq, memory_order_release);
+  }
+
+  // Record next_seq, with w records written; false if it was lost
+  bool read_record(uint64_t w, const double*& values){
+    if(w - next_seq > header->capacity){
+      lost += w - header->capacity - next_seq;
+      next_seq = w - header->capacity;
+    }
+    StreamSlot* slot = this->slot(next_seq);
+    uint64_t seq = slot->seq.load(memory_order_acquire);
+    if(seq != 2*next_seq + 2){
+      ++lost;
+      ++next_seq;
+      return false;
+    }
+
+    if(header->policy == STREAM_BLOCK && ireader >= 0){
+      values = slot->values;
+      ++next_seq;
+      return true;
+    }
+
+    memcpy(row.data(), slot->values, 8*row.size());
+    atomic_thread_fence(memory_order_acquire);
+    if(slot->seq.load(memory_order_relaxed) != seq){
+      ++lost;
+      ++next_seq;
+      return false;
+    }
+    values = row.data();
+    ++next_seq;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef __event_watchdog_h
+#define __event_watchdog_h
+
+// Per-event budget for pathological showers
+// (-max_evt_sec S, -max_evt_particles N)
+//
+// At very low lambda a single hidden valley shower can run for minutes
+// and grow the event record until memory runs out.  BudgetHook checks
+// the wall time since the hard process and the size of the event record
+// at every final-state emission; past either budget it vetoes the
+// remaining emissions and then the event at the end of the parton
+// level, and Pythia moves on to a new hard process.  Events that only
+// go over budget in the hadronization are dropped by generate_event.
+//
+// Both count as tried events that fail the selection.  Pythia counts an
+// event vetoed by a hook as tried but not accepted, which lowers
+// sigmaGen; cxn_scale() puts those events back into the cross section
+// so that cxn * npass / nevt stays right.
+//
+// The random state is copied in memory before every pythia.next() and
+// written as <output>.budget<N>.rndm only for the N-th event over
+// budget; -rndm_state restores it after initialization, so that the
+// first event of a run with the same options (and -lhe_first) is that
+// event again.  Only runs with one process and one generator can do
+// so, the others reseed theirs.  With -rehad the state is the one
+// before the parton-level event: the replay makes that event and its
+// first hadronization, not the later rehadronization that went over
+// budget, whose random numbers depend on all the hadronizations before
+// it.
+
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+
+#include "Pythia8/Pythia.h"
+
+using namespace std;
+
+class EventBudget {
+
+public:
+
+  double max_sec;        // wall time of an event, 0 for no limit
+  long max_particles;    // size of the event record, 0 for no limit
+  string base;           // of the random state files
+  long n_vetoed;         // in the parton level, by the hook
+  long n_dropped;        // after Pythia accepted them
+
+  EventBudget(): max_sec(0), max_particles(0), n_vetoed(0), n_dropped(0),
+    tripped(false), rehadronizing(false) {}
+
+  bool enabled() const {return max_sec > 0 || max_particles > 0;}
+
+  long n_over() const {return n_vetoed + n_dropped;}
+
+  // Before pythia.next(): keep the random state and start the clock
+  void begin(Pythia& pythia){
+    saved_rndm = pythia.rndm;
+    start();
+  }
+
+  // Start of a hard process, or of a rehadronization
+  void start(bool rehadronization = false){
+    t0 = chrono::steady_clock::now();
+    tripped = false;
+    rehadronizing = rehadronization;
+  }
+
+  // True once the event in the making is over budget
+  bool over(int size){
+    if(tripped)
+      return true;
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    if((max_particles > 0 && size > max_particles) || (max_sec > 0 && sec > max_sec)){
+      tripped = true;
+      report(size, sec);
+    }
+    return tripped;
+  }
+
+  // Called by the hook at the end of the parton level
+  bool veto_parton_level(){
+    if(tripped)
+      ++n_vetoed;
+    return tripped;
+  }
+
+  // After Pythia returned an event: true if it is to be dropped
+  bool drop(const Pythia8::Event& event){
+    if(!over(event.size()))
+      return false;
+    ++n_dropped;
+    return true;
+  }
+
+  // Cross section of the accepted and the vetoed events over the one
+  // of the accepted events
+  double cxn_scale(const Pythia8::Info& info) const {
+    long n_accepted = info.nAccepted();
+    return n_accepted > 0 ? (n_accepted + n_vetoed)/double(n_accepted) : 1;
+  }
+
+private:
+
+  chrono::steady_clock::time_point t0;
+  bool tripped;
+  bool rehadronizing;
+  Pythia8::Rndm saved_rndm;
+
+  void report(int size, double sec){
+    string kept = base + ".budget" + to_string(n_over()) + ".rndm";
+    cout<<"WARNING: event over budget ("<<sec<<" s, "<<size<<" particles)";
+    if(saved_rndm.dumpState(kept))
+      cout<<", random state "<<(rehadronizing ? "of its parton-level event " : "")
+          <<"in "<<kept<<" (-rndm_state)";
+    cout<<endl;
+  }
+};
+
+// A hook built elsewhere, e.g. the matching hook CombineMatchingInput
+// selects from the settings, behind a class that BudgetHook can derive
+// from.  Pythia only gives its pointers to the outer hook, so they are
+// handed on before the inner hook's own initialization.
+class ForwardingHook: public Pythia8::UserHooks {
+
+public:
+
+  ForwardingHook(): inner(NULL) {}
+
+  void set_inner(Pythia8::UserHooks* hook){inner = hook;}
+
+  virtual bool initAfterBeams(){
+    inner->initPtr(infoPtr, settingsPtr, particleDataPtr, rndmPtr, beamAPtr, beamBPtr,
+                   beamPomAPtr, beamPomBPtr, coupSMPtr, partonSystemsPtr, sigmaTotPtr);
+    return inner->initAfterBeams();
+  }
+
+  virtual bool canModifySigma(){return inner->canModifySigma();}
+  virtual double multiplySigmaBy(const Pythia8::SigmaProcess* sigma,
+                                 const Pythia8::PhaseSpace* phase_space, bool in_event){
+    return inner->multiplySigmaBy(sigma, phase_space, in_event);
+  }
+
+  virtual bool canVetoProcessLevel(){return inner->canVetoProcessLevel();}
+  virtual bool doVetoProcessLevel(Pythia8::Event& process){
+    return inner->doVetoProcessLevel(process);
+  }
+
+  virtual bool canVetoResonanceDecays(){return inner->canVetoResonanceDecays();}
+  virtual bool doVetoResonanceDecays(Pythia8::Event& process){
+    return inner->doVetoResonanceDecays(process);
+  }
+
+  virtual bool canVetoPT(){return inner->canVetoPT();}
+  virtual double scaleVetoPT(){return inner->scaleVetoPT();}
+  virtual bool doVetoPT(int type, const Pythia8::Event& event){
+    return inner->doVetoPT(type, event);
+  }
+
+  virtual bool canVetoStep(){return inner->canVetoStep();}
+  virtual int numberVetoStep(){return inner->numberVetoStep();}
+  virtual bool doVetoStep(int type, int n_isr, int n_fsr, const Pythia8::Event& event){
+    return inner->doVetoStep(type, n_isr, n_fsr, event);
+  }
+
+  virtual bool canVetoMPIStep(){return inner->canVetoMPIStep();}
+  virtual int numberVetoMPIStep(){return inner->numberVetoMPIStep();}
+  virtual bool doVetoMPIStep(int n_mpi, const Pythia8::Event& event){
+    return inner->doVetoMPIStep(n_mpi, event);
+  }
+
+  virtual bool canVetoPartonLevelEarly(){return inner->canVetoPartonLevelEarly();}
+  virtual bool doVetoPartonLevelEarly(const Pythia8::Event& event){
+    return inner->doVetoPartonLevelEarly(event);
+  }
+
+  virtual bool retryPartonLevel(){return inner->retryPartonLevel();}
+
+  virtual bool canVetoPartonLevel(){return inner->canVetoPartonLevel();}
+  virtual bool doVetoPartonLevel(const Pythia8::Event& event){
+    return inner->doVetoPartonLevel(event);
+  }
+
+  virtual bool canVetoISREmission(){return inner->canVetoISREmission();}
+  virtual bool doVetoISREmission(int size_old, const Pythia8::Event& event, int i_sys){
+    return inner->doVetoISREmission(size_old, event, i_sys);
+  }
+
+  virtual bool canVetoFSREmission(){return inner->canVetoFSREmission();}
+  virtual bool doVetoFSREmission(int size_old, const Pythia8::Event& event,
+                                 int i_sys, bool in_resonance = false){
+    return inner->doVetoFSREmission(size_old, event, i_sys, in_resonance);
+  }
+
+  virtual bool canVetoMPIEmission(){return inner->canVetoMPIEmission();}
+  virtual bool doVetoMPIEmission(int size_old, const Pythia8::Event& event){
+    return inner->doVetoMPIEmission(size_old, event);
+  }
+
+private:
+
+  Pythia8::UserHooks* inner;
+};
+
+// Watchdog on top of the hook a generator needs anyway (UserHooks
+// itself when there is none), forwarding what Base vetoes
+template<class Base>
+class BudgetHook: public Base {
+
+public:
+
+  BudgetHook(EventBudget* budget): budget(budget) {}
+
+  virtual bool canVetoProcessLevel(){return true;}
+
+  virtual bool doVetoProcessLevel(Pythia8::Event& process){
+    budget->start();
+    return Base::canVetoProcessLevel() && Base::doVetoProcessLevel(process);
+  }
+
+  virtual bool canVetoFSREmission(){return true;}
+
+  virtual bool doVetoFSREmission(int sizeOld, const Pythia8::Event& event,
+                                 int iSys, bool inResonance = false){
+    if(budget->over(event.size()))
+      return true;
+    return Base::canVetoFSREmission()
+      && Base::doVetoFSREmission(sizeOld, event, iSys, inResonance);
+  }
+
+  virtual bool canVetoPartonLevel(){return true;}
+
+  virtual bool doVetoPartonLevel(const Pythia8::Event& event){
+    if(budget->veto_parton_level())
+      return true;
+    return Base::canVetoPartonLevel() && Base::doVetoPartonLevel(event);
+  }
+
+private:
+
+  EventBudget* budget;
+};
+
+#endif
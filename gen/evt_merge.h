@@ -0,0 +1,333 @@
+#ifndef __evt_merge_h
+#define __evt_merge_h
+
+// Parallel merging of .evt shards through mmap
+//
+// Each shard is mapped read-only and scanned once for its rows (the
+// lines with a comma after the header).  The row counts fix the merged
+// evt ids and where every shard's rows go, so the shards are then
+// written concurrently into the mapped output: CSV with the evt column
+// renumbered, or columnar,
+//
+//   "MJEVT001"
+//   uint32 ncol, ncol x (uint32 length, name)
+//   uint64 nrow
+//   ncol x nrow float64, one column after the other
+//
+// in native byte order.  From numpy, after reading the header,
+//   np.fromfile(f, np.float64, ncol*nrow).reshape(ncol, nrow)
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char evt_columnar_magic[] = "MJEVT001";
+
+// A file mapped read-only, or written through a shared mapping
+class MappedEvtFile {
+
+public:
+
+  char* data;
+  size_t size;
+
+  MappedEvtFile(): data(NULL), size(0), fd(-1) {}
+  ~MappedEvtFile(){close();}
+
+  bool open_read(const string& fname){
+    fd = ::open(fname.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0)
+      return false;
+    size = st.st_size;
+    return map(PROT_READ, MAP_PRIVATE);
+  }
+
+  // A new file, not one shared through a hard link with the output
+  // cache, with its blocks allocated: a full disk fails here instead
+  // of raising SIGBUS while the mapping is written
+  bool create(const string& fname, size_t n){
+    unlink(fname.c_str());
+    fd = ::open(fname.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0)
+      return false;
+    int err = n > 0 ? posix_fallocate(fd, 0, n) : 0;
+    if(err != 0){
+      cerr<<"ERROR: cannot allocate "<<n<<" bytes for "<<fname<<": "<<strerror(err)<<endl;
+      return false;
+    }
+    size = n;
+    return map(PROT_READ | PROT_WRITE, MAP_SHARED);
+  }
+
+  void close(){
+    if(data)
+      munmap(data, size);
+    if(fd >= 0)
+      ::close(fd);
+    data = NULL;
+    fd = -1;
+  }
+
+private:
+
+  int fd;
+
+  MappedEvtFile(const MappedEvtFile&);
+
+  bool map(int prot, int flags){
+    if(size == 0)
+      return true;
+    void* ptr = mmap(NULL, size, prot, flags, fd, 0);
+    if(ptr == MAP_FAILED)
+      return false;
+    data = (char*) ptr;
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    return true;
+  }
+};
+
+struct EvtShard {
+  string path;
+  MappedEvtFile file;
+  string header;
+  size_t body;          // offset of the first row
+  long nrow;
+  size_t rest_bytes;    // of the rows from their first comma, newlines included
+  long first_id;        // merged id of the first row
+  size_t out_offset;    // of the first row in a CSV output
+
+  EvtShard(): body(0), nrow(0), rest_bytes(0), first_id(0), out_offset(0) {}
+
+  bool scan(){
+    if(!file.open_read(path))
+      return false;
+    const char* p = file.data;
+    const char* end = p + file.size;
+    if(file.size == 0)
+      return true;
+
+    const char* e = (const char*) memchr(p, '\n', end - p);
+    header.assign(p, e ? e : end);
+    body = e ? e + 1 - p : file.size;
+
+    for(p += body; p < end; ){
+      e = (const char*) memchr(p, '\n', end - p);
+      if(!e)
+        e = end;
+      const char* comma = (const char*) memchr(p, ',', e - p);
+      if(comma){
+        ++nrow;
+        rest_bytes += e - comma + 1;
+      }
+      p = e + 1;
+    }
+    return true;
+  }
+
+  // Call op(id, first, last) for each row, with [first, last) the
+  // row after its evt field, from the comma on
+  template<class Op> bool rows(Op& op) const {
+    const char* end = file.data + file.size;
+    long id = first_id;
+    for(const char* p = file.data + body; p < end; ){
+      const char* e = (const char*) memchr(p, '\n', end - p);
+      if(!e)
+        e = end;
+      const char* comma = (const char*) memchr(p, ',', e - p);
+      if(comma && !op(id++, comma, e))
+        return false;
+      p = e + 1;
+    }
+    return true;
+  }
+};
+
+// Run job(0..n-1) on nthread threads
+template<class Job> void run_parallel(size_t n, int nthread, Job job){
+  atomic<size_t> next(0);
+  vector<thread> threads;
+  for(int t=0; t<max(1, nthread); ++t)
+    threads.push_back(thread([&](){
+      for(size_t i; (i = next++) < n; )
+        job(i);
+    }));
+  for(size_t t=0; t<threads.size(); ++t)
+    threads[t].join();
+}
+
+int decimal_digits(long x){
+  int n = 1;
+  for(; x >= 10; x /= 10)
+    ++n;
+  return n;
+}
+
+// Characters of the ids first .. first+n-1
+size_t id_bytes(long first, long n){
+  size_t total = 0;
+  long last = first + n;
+  for(long lo = first, hi = 10; lo < last; hi *= 10){
+    if(lo >= hi)
+      continue;
+    long top = min(last, hi);
+    total += size_t(top - lo)*decimal_digits(lo);
+    lo = top;
+  }
+  return total;
+}
+
+char* write_id(char* out, long id){
+  char buf[24];
+  int n = 0;
+  do buf[n++] = '0' + id % 10; while((id /= 10) > 0);
+  while(n > 0)
+    *out++ = buf[--n];
+  return out;
+}
+
+// Rows of a shard into its place of a CSV output
+struct CsvRowWriter {
+  char* out;
+  bool operator()(long id, const char* first, const char* last){
+    out = write_id(out, id);
+    memcpy(out, first, last - first);
+    out += last - first;
+    *out++ = '\n';
+    return true;
+  }
+};
+
+// Rows of a shard into their places of the columns
+struct ColumnRowWriter {
+  char* columns;        // start of the first column
+  long nrow_total;
+  size_t ncol;
+  bool operator()(long id, const char* first, const char* last){
+    double x = id;
+    memcpy(columns + 8*size_t(id), &x, 8);
+    size_t c = 1;
+    for(const char* p = first; p < last && *p == ','; ++c){
+      if(c >= ncol)
+        return false;
+      char* e;
+      x = strtod(p + 1, &e);
+      memcpy(columns + 8*(c*nrow_total + id), &x, 8);
+      p = e;
+      while(p < last && *p != ',')
+        ++p;
+    }
+    return c == ncol;
+  }
+};
+
+// Merge the shards into output (.evt CSV, or columnar), renumbering
+// the evt column; false if a shard cannot be read or has other columns
+bool merge_evt_files(const vector<string>& parts, const string& output,
+                     bool columnar = false, int nthread = 1){
+  vector<EvtShard> shards(parts.size());
+  atomic<bool> ok(true);
+  run_parallel(parts.size(), nthread, [&](size_t i){
+    shards[i].path = parts[i];
+    if(!shards[i].scan()){
+      cerr<<"ERROR: cannot read "<<parts[i]<<endl;
+      ok = false;
+    }
+  });
+  if(!ok)
+    return false;
+
+  // the header of the first shard that has one
+  string header;
+  for(size_t i=0; i<shards.size() && header == ""; ++i)
+    header = shards[i].header;
+
+  long nrow = 0;
+  size_t bytes = header.size() + 1;
+  for(size_t i=0; i<shards.size(); ++i){
+    EvtShard& s = shards[i];
+    if(s.file.size > 0 && s.header != header){
+      cerr<<"ERROR: columns of "<<s.path<<" differ from the other shards"<<endl;
+      return false;
+    }
+    s.first_id = nrow;
+    s.out_offset = bytes;
+    bytes += id_bytes(nrow, s.nrow) + s.rest_bytes;
+    nrow += s.nrow;
+  }
+
+  vector<string> names;
+  size_t b = 0;
+  for(size_t e; b <= header.size(); b = e + 1){
+    e = header.find(',', b);
+    if(e == string::npos)
+      e = header.size();
+    size_t first = header.find_first_not_of(" \t\r", b);
+    size_t last = header.find_last_not_of(" \t\r", e - 1);
+    names.push_back(first < e && last != string::npos && last >= first
+                    ? header.substr(first, last - first + 1) : "");
+  }
+
+  size_t header_bytes = 8 + 4 + 8;
+  for(size_t c=0; c<names.size(); ++c)
+    header_bytes += 4 + names[c].size();
+
+  MappedEvtFile out;
+  if(!out.create(output, columnar ? header_bytes + 8*names.size()*nrow : bytes)){
+    cerr<<"ERROR: cannot write "<<output<<endl;
+    return false;
+  }
+
+  if(columnar){
+    char* p = out.data;
+    memcpy(p, evt_columnar_magic, 8);
+    p += 8;
+    uint32_t ncol = names.size();
+    memcpy(p, &ncol, 4);
+    p += 4;
+    for(size_t c=0; c<names.size(); ++c){
+      uint32_t n = names[c].size();
+      memcpy(p, &n, 4);
+      memcpy(p + 4, names[c].data(), n);
+      p += 4 + n;
+    }
+    uint64_t n = nrow;
+    memcpy(p, &n, 8);
+  }
+  else if(header.size()){
+    memcpy(out.data, header.data(), header.size());
+    out.data[header.size()] = '\n';
+  }
+
+  run_parallel(shards.size(), nthread, [&](size_t i){
+    const EvtShard& s = shards[i];
+    bool written;
+    if(columnar){
+      ColumnRowWriter writer = {out.data + header_bytes, nrow, names.size()};
+      written = s.rows(writer);
+    }
+    else {
+      CsvRowWriter writer = {out.data + s.out_offset};
+      written = s.rows(writer);
+    }
+    if(!written){
+      cerr<<"ERROR: a row of "<<s.path<<" does not match the header"<<endl;
+      ok = false;
+    }
+  });
+  return ok;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef __generator_setup_h
+#define __generator_setup_h
+
+// Pythia set up from the monojet.exe command line, shared by monojet.C
+// and the Python bindings (pymonojet.cc)
+
+#include <string>
+#include <iostream>
+
+#include "Pythia8/Pythia.h"
+#include "Pythia8Plugins/CombineMatchingInput.h"
+
+#include "CmdLine/CmdLine.hh"
+#include "tchannel_hidden.hh"
+#include "pythia_functions.h"
+#include "lhe_reader.h"
+#include "event_watchdog.h"
+
+using namespace std;
+
+// Set up a generator for the run mode given on the command line; in
+// LHE mode it reads its events from lhe_input.  With a budget its
+// events are watched by a BudgetHook.
+bool setup_pythia(Pythia& pythia, const CmdLine& cmdline,
+                  const string& mode, LHEInput* lhe_input, long seed,
+                  EventBudget* budget = NULL){
+
+  // Initialization for LHC
+  pythia.readString("Beams:eCM = " + 
+     to_st(cmdline.value<int>("-ECM", 13000)));
+
+  // Custom Higgs pT cut
+  /*
+  ParticlePTCut* HiggsPTCut = new ParticlePTCut(pt_min,25);
+  pythia.setUserHooksPtr(HiggsPTCut);  
+  */
+
+  // Check for verbose mode
+  if(!cmdline.present("-v"))
+    pythia.readString("Print:quiet = on");
+
+  // Hidden scalar production
+  if (mode == "tchannel"){ 
+
+    double mphi=
+      cmdline.value<double>("-mphi", 1000.0); // Bifundamental mass
+
+      cout << "INFO: bufundamental mass is " + to_st(mphi) << endl;
+
+      double pt_cut = cmdline.value<double>("-ptcut", 600.0); // phase-space cut on pthatmin to speed up MC generation
+
+    init_tchannel(pythia, mphi, pt_cut);
+
+    init_hidden(pythia,
+    cmdline.value<double>("-phimass", 20.0),
+    cmdline.value<double>("-lambda", 10),
+    cmdline.value<double>("-inv", 0.3),
+    cmdline.value<bool>("-run", true),
+    cmdline.value<int>("-Nc", 2),   
+    cmdline.value<int>("-NFf", 2),    
+    cmdline.value<int>("-NBf", 0)
+    );  
+
+    if(budget)
+      pythia.setUserHooksPtr(new BudgetHook<UserHooks>(budget));
+  }  
+  
+  else if(mode == "lhe"){
+    //read lhe file
+    // the watchdog goes on top of the matching hook
+    CombineMatchingInput combined;
+    UserHooks* matching = combined.getHook(pythia);
+    if (!matching) {
+      cout<<"ERROR: cannot obtain matching pointer"<<endl;
+      return false;
+    }
+    if(budget){
+      BudgetHook<ForwardingHook>* watched = new BudgetHook<ForwardingHook>(budget);
+      watched->set_inner(matching);
+      matching = watched;
+    }
+    
+    pythia.setUserHooksPtr(matching);
+
+    init_hidden(pythia,
+    cmdline.value<double>("-phimass", 20.0),
+    cmdline.value<double>("-lambda", 10),
+    cmdline.value<double>("-inv", 0.3),
+    cmdline.value<bool>("-run", true),
+    cmdline.value<int>("-Nc", 2),   
+    cmdline.value<int>("-NFf", 2),    
+    cmdline.value<int>("-NBf", 0)
+    );  
+
+    pythia.readString("Init:showChangedParticleData = off");
+    pythia.readString("Beams:frameType = 5");
+    pythia.setLHAupPtr(lhe_input->make_lhaup(pythia));
+
+    pythia.readString("JetMatching:merge = on");
+    pythia.readString("JetMatching:setMad = on");
+    pythia.readString("JetMatching:scheme = 1");
+    
+    pythia.readString("JetMatching:jetAlgorithm = 2");
+    pythia.readString("JetMatching:exclusive = 2");
+    pythia.readString("JetMatching:nJetMax = " + to_st(cmdline.value<int>("-nmatch", 1)));
+  } 
+  else
+  {
+    cerr<<"ERROR: mode: " << mode << " not supported, exiting..." << endl;
+    return false;
+  }
+  
+  // Set seed
+  pythia.readString("Random:setSeed = on");
+  // Fix random seed
+  pythia.readString("Random:seed = " + to_string(seed));
+  // Rehadronization turned on
+  if(cmdline.present("-rehad"))
+    pythia.readString("HadronLevel:all = off");
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __hash_h
+#define __hash_h
+
+// Small non-cryptographic hashing helpers (64-bit FNV-1a), used to
+// build content digests of settings and files
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdint.h>
+
+using namespace std;
+
+class Hasher {
+
+public:
+
+  uint64_t value;
+
+  Hasher(): value(14695981039346656037ULL) {}
+
+  Hasher& add(const char* data, size_t n){
+    for(size_t i=0; i<n; ++i){
+      value ^= (unsigned char) data[i];
+      value *= 1099511628211ULL;
+    }
+    return *this;
+  }
+
+  // strings are length-prefixed so that ("ab","c") != ("a","bc")
+  Hasher& add(const string& s){
+    uint64_t n = s.size();
+    add((const char*) &n, sizeof(n));
+    return add(s.data(), s.size());
+  }
+
+  Hasher& add(double x){
+    ostringstream sout;
+    sout << setprecision(17) << x;
+    return add(sout.str());
+  }
+
+  // Content of a file, false if it cannot be read
+  bool add_file(const string& fname){
+    ifstream fin(fname.c_str(), ios::binary);
+    if(!fin.good())
+      return false;
+    char buf[65536];
+    while(fin.read(buf, sizeof(buf)) || fin.gcount() > 0)
+      add(buf, fin.gcount());
+    return true;
+  }
+
+  string hex() const {
+    ostringstream sout;
+    sout << setfill('0') << std::hex << setw(16) << value;
+    return sout.str();
+  }
+};
+
+string hash_string(const string& s){
+  return Hasher().add(s).hex();
+}
+
+#endif
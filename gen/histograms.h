@@ -0,0 +1,361 @@
+#ifndef __histograms_h
+#define __histograms_h
+
+// In-generator 1-D histograms of the event level variables
+// (MEt, dphi, mjj, Mt...), booked from a small text config.
+//
+// Every worker owns its own HistogramSet and fills it without any
+// locking; sets with identical binning are merged with add() at the
+// end of the run (or across jobs with merge_hists).  Bin contents are
+// plain sums of weights and squared weights, so merging is exact.
+//
+// Config format, one histogram per line ('#' starts a comment):
+//
+//   # name   column   binning
+//   met      MEt      50 0 1000
+//   dphi     dphi     32 0 3.2
+//   mt       Mt       var 0,250,500,750,1000,1500,2500
+//
+// where column is one of the .evt column names.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include "json_lite.h"
+
+using namespace std;
+
+class Histogram {
+
+public:
+
+  string name;
+  string column;
+
+  // nbins+1 bin edges
+  vector<double> edges;
+
+  // nbins+2 entries: [0] is the underflow, [nbins+1] the overflow
+  vector<double> sumw;
+  vector<double> sumw2;
+  long entries;
+
+  // index of column in the row passed to fill, -1 if unbound
+  int col_index;
+
+  Histogram(): entries(0), col_index(-1), uniform(false), lo(0), inv_width(0) {}
+
+  // fixed binning
+  Histogram(const string& name, const string& column,
+            int nbins, double lo, double hi):
+    name(name), column(column), entries(0), col_index(-1)
+  {
+    for(int i=0; i<=nbins; ++i)
+      edges.push_back(lo + (hi-lo)*i/nbins);
+    setup();
+  }
+
+  // variable binning, edges must be increasing
+  Histogram(const string& name, const string& column,
+            const vector<double>& edges_):
+    name(name), column(column), edges(edges_), entries(0), col_index(-1)
+  {
+    setup();
+  }
+
+  int nbins() const {return int(edges.size()) - 1;}
+
+  // Bin number in the sumw convention (0 underflow, nbins+1 overflow)
+  int find_bin(double x) const {
+    if(!(x >= edges.front()))
+      return 0;
+    if(x >= edges.back())
+      return nbins() + 1;
+
+    if(uniform){
+      int ibin = int((x - lo)*inv_width);
+      // protect against rounding at the upper edges
+      if(ibin >= nbins()) ibin = nbins() - 1;
+      return ibin + 1;
+    }
+
+    return int(upper_bound(edges.begin(), edges.end(), x) - edges.begin());
+  }
+
+  void fill(double x, double w=1.0){
+    int ibin = find_bin(x);
+    sumw[ibin] += w;
+    sumw2[ibin] += w*w;
+    ++entries;
+  }
+
+  // Empty the contents, keep the binning
+  void reset(){
+    fill_n(sumw.begin(), sumw.size(), 0.0);
+    fill_n(sumw2.begin(), sumw2.size(), 0.0);
+    entries = 0;
+  }
+
+  bool compatible(const Histogram& other) const {
+    return name == other.name && column == other.column &&
+      edges == other.edges;
+  }
+
+  bool add(const Histogram& other){
+    if(!compatible(other))
+      return false;
+    for(size_t i=0; i<sumw.size(); ++i){
+      sumw[i] += other.sumw[i];
+      sumw2[i] += other.sumw2[i];
+    }
+    entries += other.entries;
+    return true;
+  }
+
+  void write_json(ostream& out) const {
+    out << "{\"name\":\"" << json_escape(name) << "\","
+        << "\"column\":\"" << json_escape(column) << "\","
+        << "\"entries\":" << entries << ",";
+    write_array(out, "edges", edges);
+    out << ",";
+    write_array(out, "sumw", sumw);
+    out << ",";
+    write_array(out, "sumw2", sumw2);
+    out << "}";
+  }
+
+  bool read_json(const JsonValue& v){
+    name = v.text("name");
+    column = v.text("column");
+    entries = long(v.num("entries"));
+    if(!read_array(v.get("edges"), edges) ||
+       !read_array(v.get("sumw"), sumw) ||
+       !read_array(v.get("sumw2"), sumw2))
+      return false;
+    if(edges.size() < 2 || sumw.size() != edges.size() + 1 ||
+       sumw2.size() != sumw.size())
+      return false;
+    setup_lookup();
+    return true;
+  }
+
+private:
+
+  bool uniform;
+  double lo, inv_width;
+
+  void setup(){
+    sumw.assign(edges.size() + 1, 0.0);
+    sumw2.assign(edges.size() + 1, 0.0);
+    setup_lookup();
+  }
+
+  // use the fast path when all bins have the same width
+  void setup_lookup(){
+    lo = edges.front();
+    double width = (edges.back() - edges.front()) / nbins();
+    inv_width = 1.0 / width;
+    uniform = true;
+    for(int i=0; i<=nbins(); ++i)
+      if(fabs(edges[i] - (lo + i*width)) > 1e-9*fabs(width))
+        uniform = false;
+  }
+
+  static void write_array(ostream& out, const string& key,
+                          const vector<double>& ary){
+    out << "\"" << key << "\":[";
+    for(size_t i=0; i<ary.size(); ++i){
+      if(i) out << ",";
+      out << json_number(ary[i]);
+    }
+    out << "]";
+  }
+
+  static bool read_array(const JsonValue* v, vector<double>& ary){
+    if(!v || v->type != JsonValue::Array)
+      return false;
+    ary.resize(v->array.size());
+    for(size_t i=0; i<ary.size(); ++i)
+      ary[i] = v->array[i].type == JsonValue::Number ? v->array[i].number : NAN;
+    return true;
+  }
+};
+
+
+class HistogramSet {
+
+public:
+
+  vector<Histogram> hists;
+
+  // Read the booking config, returns false on error
+  bool read_config(const string& filename){
+    ifstream fin(filename.c_str());
+    if(!fin.good()){
+      cerr<<"ERROR: cannot open histogram config "<<filename<<endl;
+      return false;
+    }
+
+    string line;
+    int iline = 0;
+    while(getline(fin, line)){
+      ++iline;
+      size_t comment = line.find('#');
+      if(comment != string::npos)
+        line = line.substr(0, comment);
+
+      istringstream sin(line);
+      string name, column, binning;
+      if(!(sin >> name))
+        continue;
+
+      sin >> column >> binning;
+
+      if(binning == "var"){
+        string list;
+        sin >> list;
+        replace(list.begin(), list.end(), ',', ' ');
+        istringstream slist(list);
+        vector<double> edges;
+        double x;
+        while(slist >> x)
+          edges.push_back(x);
+
+        bool increasing = edges.size() >= 2;
+        for(size_t i=1; i<edges.size(); ++i)
+          increasing = increasing && edges[i] > edges[i-1];
+        if(!increasing){
+          cerr<<"ERROR: "<<filename<<":"<<iline
+              <<" bin edges must be increasing"<<endl;
+          return false;
+        }
+        hists.push_back(Histogram(name, column, edges));
+      }
+      else {
+        istringstream sbin(binning);
+        int nbins = 0;
+        double lo = 0, hi = 0;
+        sbin >> nbins;
+        sin >> lo >> hi;
+        if(sin.fail() || nbins <= 0 || hi <= lo){
+          cerr<<"ERROR: "<<filename<<":"<<iline
+              <<" expected: name column nbins lo hi"<<endl;
+          return false;
+        }
+        hists.push_back(Histogram(name, column, nbins, lo, hi));
+      }
+    }
+    return true;
+  }
+
+  // Resolve the column of each histogram against the row layout
+  bool bind(const vector<string>& columns){
+    bool ok = true;
+    for(size_t i=0; i<hists.size(); ++i){
+      vector<string>::const_iterator it =
+        find(columns.begin(), columns.end(), hists[i].column);
+      if(it == columns.end()){
+        cerr<<"ERROR: histogram "<<hists[i].name
+            <<" uses unknown column "<<hists[i].column<<endl;
+        ok = false;
+        continue;
+      }
+      hists[i].col_index = int(it - columns.begin());
+    }
+    return ok;
+  }
+
+  // Fill every histogram from one event row
+  void fill(const double* row, double weight=1.0){
+    for(size_t i=0; i<hists.size(); ++i)
+      if(hists[i].col_index >= 0)
+        hists[i].fill(row[hists[i].col_index], weight);
+  }
+
+  void reset(){
+    for(size_t i=0; i<hists.size(); ++i)
+      hists[i].reset();
+  }
+
+  bool empty() const {return hists.empty();}
+
+  // Merge another set with the same booking
+  bool add(const HistogramSet& other){
+    if(other.hists.size() != hists.size())
+      return false;
+    for(size_t i=0; i<hists.size(); ++i)
+      if(!hists[i].compatible(other.hists[i]))
+        return false;
+    for(size_t i=0; i<hists.size(); ++i)
+      hists[i].add(other.hists[i]);
+    return true;
+  }
+
+  // Normalization info (nevt, cxn...) is kept alongside the
+  // histograms so that merged files can still be weighted
+  void write_json(ostream& out,
+                  const vector<pair<string, double> >& info =
+                  vector<pair<string, double> >()) const {
+    out << setprecision(17);
+    out << "{\"info\":{";
+    for(size_t i=0; i<info.size(); ++i){
+      if(i) out << ",";
+      out << "\"" << json_escape(info[i].first) << "\":" << json_number(info[i].second);
+    }
+    out << "},\n\"histograms\":[\n";
+    for(size_t i=0; i<hists.size(); ++i){
+      if(i) out << ",\n";
+      hists[i].write_json(out);
+    }
+    out << "\n]}" << endl;
+  }
+
+  bool write_json(const string& filename,
+                  const vector<pair<string, double> >& info =
+                  vector<pair<string, double> >()) const {
+    ofstream fout(filename.c_str());
+    if(!fout.good()){
+      cerr<<"ERROR: cannot write histograms to "<<filename<<endl;
+      return false;
+    }
+    write_json(fout, info);
+    return fout.good();
+  }
+
+  bool read_json(const string& filename,
+                 vector<pair<string, double> >* info=NULL){
+    ifstream fin(filename.c_str());
+    if(!fin.good())
+      return false;
+    stringstream buffer;
+    buffer << fin.rdbuf();
+
+    JsonValue root;
+    if(!json_parse(buffer.str(), root))
+      return false;
+
+    const JsonValue* jhists = root.get("histograms");
+    if(!jhists || jhists->type != JsonValue::Array)
+      return false;
+
+    hists.resize(jhists->array.size());
+    for(size_t i=0; i<hists.size(); ++i)
+      if(!hists[i].read_json(jhists->array[i]))
+        return false;
+
+    const JsonValue* jinfo = root.get("info");
+    if(info && jinfo)
+      for(size_t i=0; i<jinfo->object.size(); ++i)
+        info->push_back(make_pair(jinfo->object[i].first,
+                                  jinfo->object[i].second.number));
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef __init_cache_h
+#define __init_cache_h
+
+// Content-hashed cache of the Pythia initialization
+//
+// The digest covers everything that defines the hard process and the
+// beams: the changed Pythia settings (seed and printout excluded),
+// the hidden valley masses and decay tables, and the inputs that are
+// not Pythia settings (run mode, bifundamental mass, LHE file).
+// Changing any of them gives a new digest, so stale entries are never
+// used.  Each entry in the cache directory holds
+//
+//   <digest>.cmnd   the settings snapshot, usable with readFile
+//   <digest>.init   decay tables after init, per-process cross
+//                   sections and the init time
+//   <digest>.mpi    the MPI initialization, reused by Pythia itself
+//                   through MultipartonInteractions:reuseInit
+//
+// Files are written under a per-process temporary name and renamed
+// into place, so concurrent jobs sharing a digest never read a
+// partial entry.
+//
+// Pythia offers no way to hand back the phase-space maxima of a
+// process, so that search is still done; the cached cross sections
+// are used to check that a new run agrees with the previous ones.
+//
+// The cache must not change the events: a hit skips the MPI
+// initialization and the random numbers it draws, so the generator is
+// reseeded with the job seed after init(), hit, miss or no cache.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Pythia8/Pythia.h"
+#include "hash.h"
+
+using namespace std;
+
+// Particles whose properties are set up by init_hidden
+const int init_cache_ids[] = {4900101, 4900111, 4900113, 4900211, 4900213};
+
+class InitCache {
+
+public:
+
+  string dir;
+  string digest;
+  bool enabled;
+  bool hit;
+  double init_seconds;
+
+  InitCache(): enabled(false), hit(false), init_seconds(0),
+    cached_cxn(0), cached_err(0) {}
+
+  // To be called once all settings are read, just before init().
+  // inputs describes what is not in the Pythia settings.
+  void prepare(Pythia& pythia, const string& cache_dir, const string& inputs,
+               const string& input_file = ""){
+    dir = cache_dir;
+    enabled = true;
+    mkdir(dir.c_str(), 0755);
+
+    Hasher h;
+    h.add(string("init_cache v1"));
+    h.add(settings_snapshot(pythia));
+    h.add(decay_tables(pythia));
+    h.add(inputs);
+
+    // LHE files are identified by name, size and modification time
+    struct stat st;
+    if(input_file != "" && stat(input_file.c_str(), &st) == 0){
+      h.add(input_file);
+      h.add(double(st.st_size));
+      h.add(double(st.st_mtime));
+    }
+    digest = h.hex();
+
+    ifstream fin(path(".init").c_str());
+    hit = fin.good();
+    if(hit)
+      read_entry(fin);
+
+    cout<<"INFO: init cache "<<(hit ? "hit" : "miss")<<", digest "<<digest<<endl;
+
+    // keep the snapshot for reference/reproduction
+    if(!hit){
+      string tmp = tmp_path(".cmnd");
+      ofstream fcmnd(tmp.c_str());
+      fcmnd << settings_snapshot(pythia);
+      fcmnd.close();
+      rename(tmp.c_str(), path(".cmnd").c_str());
+    }
+
+    // reuse the MPI initialization if it exists, otherwise save it
+    // under a temporary name, renamed into place by init()
+    struct stat mpi_st;
+    mpi_tmp = stat(path(".mpi").c_str(), &mpi_st) == 0 ? "" : tmp_path(".mpi");
+    pythia.readString("MultipartonInteractions:reuseInit = 3");
+    pythia.readString("MultipartonInteractions:initFile = " +
+                      (mpi_tmp != "" ? mpi_tmp : path(".mpi")));
+  }
+
+  // Time the initialization, restart the random numbers from the job
+  // seed and validate the decay tables against the ones of the cached
+  // run
+  bool init(Pythia& pythia){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool ok = pythia.init();
+    init_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    pythia.rndm.init(pythia.settings.mode("Random:seed"));
+
+    if(!enabled)
+      return ok;
+
+    if(mpi_tmp != ""){
+      if(ok)
+        rename(mpi_tmp.c_str(), path(".mpi").c_str());
+      else
+        remove(mpi_tmp.c_str());
+    }
+
+    after_tables = decay_tables(pythia);
+    if(hit && after_tables != cached_tables){
+      cout<<"WARNING: decay tables differ from the cached run, "
+          <<"the cache entry will be replaced"<<endl;
+      hit = false;
+    }
+    cout<<"INFO: Pythia init took "<<init_seconds<<" s"
+        <<(hit ? " (cached MPI init)" : "")<<endl;
+    return ok;
+  }
+
+  // Store the cross sections of this run, keeping the most precise
+  // estimate when the entry already exists
+  void store(Pythia& pythia){
+    if(!enabled)
+      return;
+
+    double err = pythia.info.sigmaErr();
+    if(hit && cached_err > 0 && err >= cached_err){
+      compare(pythia);
+      return;
+    }
+    if(hit)
+      compare(pythia);
+
+    string tmp = tmp_path(".init");
+    ofstream fout(tmp.c_str());
+    fout << setprecision(10);
+    fout << "digest " << digest << "\n";
+    fout << "init_seconds " << init_seconds << "\n";
+    fout << "cxn " << pythia.info.sigmaGen() << " " << err << "\n";
+
+    vector<int> codes = pythia.info.codesHard();
+    for(size_t i=0; i<codes.size(); ++i)
+      fout << "proc " << codes[i] << " "
+           << pythia.info.sigmaGen(codes[i]) << " "
+           << pythia.info.sigmaErr(codes[i]) << " "
+           << pythia.info.nAccepted(codes[i]) << " "
+           << pythia.info.nameProc(codes[i]) << "\n";
+
+    fout << after_tables;
+    fout.close();
+
+    // atomic for concurrent jobs sharing the cache
+    rename(tmp.c_str(), path(".init").c_str());
+  }
+
+private:
+
+  string cached_tables, after_tables;
+  string mpi_tmp;
+  double cached_cxn, cached_err;
+
+  string path(const string& ext) const {
+    return dir + "/" + digest + ext;
+  }
+
+  // Private to this process until renamed to path(ext)
+  string tmp_path(const string& ext) const {
+    return dir + "/.tmp_" + digest + ext + "_" + to_string(getpid());
+  }
+
+  // Changed settings, without those that do not affect the results
+  static string settings_snapshot(Pythia& pythia){
+    ostringstream sall;
+    pythia.settings.writeFile(sall, false);
+
+    const char* skip[] = {"Random:", "Print:", "Init:", "Next:", "Main:",
+                          "MultipartonInteractions:reuseInit",
+                          "MultipartonInteractions:initFile"};
+
+    istringstream sin(sall.str());
+    ostringstream sout;
+    string line;
+    while(getline(sin, line)){
+      bool keep = true;
+      for(size_t i=0; i<sizeof(skip)/sizeof(skip[0]); ++i)
+        if(line.compare(0, string(skip[i]).size(), skip[i]) == 0)
+          keep = false;
+      if(keep)
+        sout << line << "\n";
+    }
+    return sout.str();
+  }
+
+  static string decay_tables(Pythia& pythia){
+    ostringstream sout;
+    sout << setprecision(10);
+    for(size_t k=0; k<sizeof(init_cache_ids)/sizeof(int); ++k){
+      int id = init_cache_ids[k];
+      ParticleDataEntry* entry = pythia.particleData.particleDataEntryPtr(id);
+      if(!entry)
+        continue;
+      sout << "particle " << id << " " << entry->m0() << " "
+           << entry->mWidth() << " " << entry->mMin() << " "
+           << entry->mMax() << "\n";
+      for(int i=0; i<entry->sizeChannels(); ++i){
+        const DecayChannel& ch = entry->channel(i);
+        sout << "channel " << id << " " << ch.onMode() << " "
+             << ch.bRatio() << " " << ch.meMode();
+        for(int j=0; j<ch.multiplicity(); ++j)
+          sout << " " << ch.product(j);
+        sout << "\n";
+      }
+    }
+    return sout.str();
+  }
+
+  void read_entry(istream& fin){
+    cached_cxn = cached_err = 0;
+    string line;
+    ostringstream tables;
+    while(getline(fin, line)){
+      istringstream sin(line);
+      string key;
+      sin >> key;
+      if(key == "cxn")
+        sin >> cached_cxn >> cached_err;
+      else if(key == "particle" || key == "channel")
+        tables << line << "\n";
+    }
+    cached_tables = tables.str();
+  }
+
+  // Flag runs incompatible with the cached cross section
+  void compare(Pythia& pythia){
+    double cxn = pythia.info.sigmaGen(), err = pythia.info.sigmaErr();
+    double tot_err = sqrt(err*err + cached_err*cached_err);
+    if(tot_err > 0 && fabs(cxn - cached_cxn) > 5*tot_err)
+      cout<<"WARNING: cross section "<<cxn<<" +- "<<err
+          <<" mb differs from the cached "<<cached_cxn<<" +- "<<cached_err
+          <<" mb"<<endl;
+  }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef __json_lite_h
+#define __json_lite_h
+
+// Minimal JSON reader/writer helpers for the small machine-readable
+// files written by the generator (histograms, metrics...).
+// Not a general purpose library: no unicode escapes beyond \uXXXX
+// pass-through, numbers are always read as double.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <utility>
+#include <ostream>
+
+using namespace std;
+
+struct JsonValue {
+
+  enum Type {Null, Bool, Number, String, Array, Object};
+
+  Type type;
+  bool boolean;
+  double number;
+  string str;
+  vector<JsonValue> array;
+  vector<pair<string, JsonValue> > object;
+
+  JsonValue(): type(Null), boolean(false), number(0) {}
+
+  // Look up a key in an object, NULL if absent
+  const JsonValue* get(const string& key) const {
+    if(type != Object)
+      return NULL;
+    for(size_t i=0; i<object.size(); ++i)
+      if(object[i].first == key)
+        return &object[i].second;
+    return NULL;
+  }
+
+  double num(const string& key, double def=0) const {
+    const JsonValue* v = get(key);
+    return (v && v->type == Number) ? v->number : def;
+  }
+
+  string text(const string& key, const string& def="") const {
+    const JsonValue* v = get(key);
+    return (v && v->type == String) ? v->str : def;
+  }
+};
+
+class JsonParser {
+
+public:
+
+  JsonParser(const string& text): s(text), pos(0) {}
+
+  bool parse(JsonValue& out){
+    if(!value(out))
+      return false;
+    skip();
+    return pos == s.size();
+  }
+
+  // Position of the first parse error
+  size_t position() const {return pos;}
+
+private:
+
+  const string& s;
+  size_t pos;
+
+  void skip(){
+    while(pos < s.size() &&
+          (s[pos]==' ' || s[pos]=='\n' || s[pos]=='\t' || s[pos]=='\r'))
+      ++pos;
+  }
+
+  bool literal(const char* word){
+    size_t n = string(word).size();
+    if(s.compare(pos, n, word) != 0)
+      return false;
+    pos += n;
+    return true;
+  }
+
+  bool string_value(string& out){
+    if(s[pos] != '"')
+      return false;
+    ++pos;
+    out.clear();
+    while(pos < s.size() && s[pos] != '"'){
+      char c = s[pos++];
+      if(c == '\\' && pos < s.size()){
+        char e = s[pos++];
+        switch(e){
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': out += "\\u"; break;
+        default: out += e;
+        }
+      }
+      else
+        out += c;
+    }
+    if(pos >= s.size())
+      return false;
+    ++pos;
+    return true;
+  }
+
+  bool value(JsonValue& out){
+    skip();
+    if(pos >= s.size())
+      return false;
+
+    char c = s[pos];
+
+    if(c == '{'){
+      out.type = JsonValue::Object;
+      ++pos; skip();
+      if(pos < s.size() && s[pos] == '}'){ ++pos; return true; }
+      while(true){
+        skip();
+        string key;
+        if(pos >= s.size() || !string_value(key))
+          return false;
+        skip();
+        if(pos >= s.size() || s[pos] != ':')
+          return false;
+        ++pos;
+        out.object.push_back(make_pair(key, JsonValue()));
+        if(!value(out.object.back().second))
+          return false;
+        skip();
+        if(pos < s.size() && s[pos] == ','){ ++pos; continue; }
+        if(pos < s.size() && s[pos] == '}'){ ++pos; return true; }
+        return false;
+      }
+    }
+
+    if(c == '['){
+      out.type = JsonValue::Array;
+      ++pos; skip();
+      if(pos < s.size() && s[pos] == ']'){ ++pos; return true; }
+      while(true){
+        out.array.push_back(JsonValue());
+        if(!value(out.array.back()))
+          return false;
+        skip();
+        if(pos < s.size() && s[pos] == ','){ ++pos; continue; }
+        if(pos < s.size() && s[pos] == ']'){ ++pos; return true; }
+        return false;
+      }
+    }
+
+    if(c == '"'){
+      out.type = JsonValue::String;
+      return string_value(out.str);
+    }
+
+    if(literal("true")){ out.type = JsonValue::Bool; out.boolean = true; return true; }
+    if(literal("false")){ out.type = JsonValue::Bool; out.boolean = false; return true; }
+    if(literal("null")){ out.type = JsonValue::Null; return true; }
+
+    // otherwise it must be a number
+    const char* begin = s.c_str() + pos;
+    char* end = NULL;
+    out.number = strtod(begin, &end);
+    if(end == begin)
+      return false;
+    out.type = JsonValue::Number;
+    pos += end - begin;
+    return true;
+  }
+};
+
+bool json_parse(const string& text, JsonValue& out){
+  JsonParser parser(text);
+  return parser.parse(out);
+}
+
+// A double for a JSON file, written as null when it is NaN or infinite,
+// which JSON cannot represent: out << json_number(x)
+struct JsonNumber {
+  double value;
+};
+
+JsonNumber json_number(double x){
+  JsonNumber n = {x};
+  return n;
+}
+
+ostream& operator<<(ostream& out, const JsonNumber& n){
+  if(std::isfinite(n.value))
+    out << n.value;
+  else
+    out << "null";
+  return out;
+}
+
+string json_escape(const string& input){
+  string out;
+  for(size_t i=0; i<input.size(); ++i){
+    char c = input[i];
+    if(c == '"' || c == '\\'){
+      out += '\\';
+      out += c;
+    }
+    else if(c == '\n')
+      out += "\\n";
+    else if(c == '\t')
+      out += "\\t";
+    else
+      out += c;
+  }
+  return out;
+}
+
+#endif
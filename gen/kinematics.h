@@ -0,0 +1,82 @@
+#ifndef __kinematics_h
+#define __kinematics_h
+
+// Batch kinematics on structure-of-arrays collections
+//
+// Each kernel runs one branch-free loop over contiguous arrays of n
+// entries (jets of a block of events, or one entry per event), so
+// that the compiler can vectorize it.  Conventions follow FastJet as
+// used by the event selection: phi differences are folded into
+// [0, pi], negative m2 gives a negative mass, and rapidities are
+// 0.5 ln((E+pz)/(E-pz)).
+//
+// The sqrt loops only vectorize with -fno-math-errno; the
+// trigonometric ones need a vector math library (-ffast-math with
+// glibc's libmvec).
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+static const double kin_pi = 3.14159265358979323846;
+
+// (pt, eta, phi, m) -> (px, py, pz, E)
+template<class T>
+void kin_cartesian(size_t n, const T* pt, const T* eta, const T* phi,
+                   const T* mass, double* px, double* py, double* pz,
+                   double* e){
+  for(size_t i=0; i<n; ++i){
+    double p_t = pt[i];
+    double p_z = p_t*std::sinh(double(eta[i]));
+    px[i] = p_t*std::cos(double(phi[i]));
+    py[i] = p_t*std::sin(double(phi[i]));
+    pz[i] = p_z;
+    e[i] = std::sqrt(p_t*p_t + p_z*p_z + double(mass[i])*double(mass[i]));
+  }
+}
+
+// Rapidity from E and pz
+void kin_rapidity(size_t n, const double* e, const double* pz, double* y){
+  for(size_t i=0; i<n; ++i)
+    y[i] = 0.5*std::log((e[i] + pz[i])/(e[i] - pz[i]));
+}
+
+// |phi_a - phi_b| folded into [0, pi], for angles in (-2pi, 2pi)
+inline double kin_dphi(double a, double b){
+  double d = std::fabs(a - b);
+  return std::min(d, 2*kin_pi - d);
+}
+
+// dphi of each entry to its own reference angle
+template<class T>
+void kin_dphi(size_t n, const double* phi0, const T* phi, double* dphi){
+  for(size_t i=0; i<n; ++i)
+    dphi[i] = kin_dphi(phi0[i], double(phi[i]));
+}
+
+// Azimuth of each (px, py)
+void kin_phi(size_t n, const double* px, const double* py, double* phi){
+  for(size_t i=0; i<n; ++i)
+    phi[i] = std::atan2(py[i], px[i]);
+}
+
+// Invariant mass of the sum of two four-vectors, entry by entry
+void kin_pair_mass(size_t n,
+                   const double* px1, const double* py1, const double* pz1, const double* e1,
+                   const double* px2, const double* py2, const double* pz2, const double* e2,
+                   double* m){
+  for(size_t i=0; i<n; ++i){
+    double x = px1[i] + px2[i], y = py1[i] + py2[i], z = pz1[i] + pz2[i];
+    double t = e1[i] + e2[i];
+    double m2 = t*t - x*x - y*y - z*z;
+    m[i] = m2 < 0 ? -std::sqrt(-m2) : std::sqrt(m2);
+  }
+}
+
+// Transverse mass sqrt(E^2 - pz^2) of (E, pz) sums, as PseudoJet::mperp
+void kin_mperp(size_t n, const double* e, const double* pz, double* mt){
+  for(size_t i=0; i<n; ++i)
+    mt[i] = std::sqrt(std::fabs((e[i] + pz[i])*(e[i] - pz[i])));
+}
+
+#endif
@@ -0,0 +1,130 @@
+// Accuracy check of the batch kinematics kernels against FastJet and
+// the event selection
+//
+// Usage: kinematics_check [-n (100000)] [-seed (1)] [-tol (1e-9)]
+//
+// Draws random jets and MET, computes each quantity of the .evt columns
+// both through kinematics.h, as reselect does, and through PseudoJet
+// and pythia_functions.h, as the selection of monojet.exe does, and
+// prints the largest deviation of each one:
+//
+//   phi     kin_phi            vs PseudoJet::phi_std
+//   y       kin_rapidity       vs PseudoJet::rap
+//   mjj     kin_pair_mass      vs (j1 + j2).m()
+//   Mt      kin_mperp          vs (MEt + j1 + j2).mperp()
+//   dphi    kin_dphi, min of 4 vs get_dphijj, including angles either
+//                                 side of +-pi
+//
+// Deviations are relative to the scale of each quantity (E^2/m for
+// masses).  Exits with 1 if any is above -tol.  Build like
+// monojet.exe, with tchannel_hidden.cc and its flags.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+
+#include "CmdLine/CmdLine.hh"
+#include "pythia_functions.h"
+#include "kinematics.h"
+
+using namespace std;
+
+// Largest deviation of one quantity
+struct Deviation {
+  string name;
+  double max_dev;
+  double at_value;
+
+  Deviation(const string& name): name(name), max_dev(0), at_value(0) {}
+
+  void add(double kernel, double reference, double scale){
+    double dev = fabs(kernel - reference)/max(scale, 1e-300);
+    if(dev > max_dev){
+      max_dev = dev;
+      at_value = reference;
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  long n = cmdline.value<long>("-n", 100000);
+  double tol = cmdline.value<double>("-tol", 1e-9);
+  mt19937_64 rng(cmdline.value<long>("-seed", 1));
+
+  uniform_real_distribution<double> u_eta(-5, 5), u_phi(-kin_pi, kin_pi),
+    u_logpt(log(20.), log(3000.)), u_mass(0, 200), u_eps(0, 1e-6);
+
+  Deviation d_phi("phi"), d_y("y"), d_mjj("mjj"), d_mt("Mt"), d_dphi("dphi");
+
+  // four jets and the MET of one event, as the selection sees them
+  const int njet = 4;
+  vector<double> pt(njet), eta(njet), phi(njet), mass(njet);
+  vector<double> px(njet), py(njet), pz(njet), e(njet), y(njet), phi_out(njet);
+  vector<double> met_phi(njet), dphi(njet);
+  vector<PseudoJet> jets(njet);
+
+  for(long ievt=0; ievt<n; ++ievt){
+    for(int j=0; j<njet; ++j){
+      pt[j] = exp(u_logpt(rng));
+      eta[j] = u_eta(rng);
+      phi[j] = u_phi(rng);
+      mass[j] = u_mass(rng);
+    }
+
+    // every fourth event puts the MET and the jets either side of +-pi
+    double met = exp(u_logpt(rng)), met_angle = u_phi(rng);
+    if(ievt % 4 == 0){
+      met_angle = (ievt % 8 == 0 ? 1 : -1)*(kin_pi - u_eps(rng));
+      for(int j=0; j<njet; ++j)
+        phi[j] = -met_angle + (j % 2 ? 1 : -1)*u_eps(rng);
+    }
+    PseudoJet MEt(met*cos(met_angle), met*sin(met_angle), 0, met);
+
+    kin_cartesian(njet, pt.data(), eta.data(), phi.data(), mass.data(),
+                  px.data(), py.data(), pz.data(), e.data());
+    kin_rapidity(njet, e.data(), pz.data(), y.data());
+    kin_phi(njet, px.data(), py.data(), phi_out.data());
+    for(int j=0; j<njet; ++j){
+      jets[j] = PseudoJet(px[j], py[j], pz[j], e[j]);
+      met_phi[j] = atan2(MEt.py(), MEt.px());
+    }
+    kin_dphi(njet, met_phi.data(), phi_out.data(), dphi.data());
+
+    for(int j=0; j<njet; ++j){
+      d_phi.add(phi_out[j], jets[j].phi_std(), 1);
+      d_y.add(y[j], jets[j].rap(), max(1., fabs(y[j])));
+    }
+
+    double min_dphi = 999;
+    for(int j=0; j<njet; ++j)
+      min_dphi = min(min_dphi, dphi[j]);
+    d_dphi.add(min_dphi, get_dphijj(MEt, jets), 1);
+
+    double mjj;
+    kin_pair_mass(1, &px[0], &py[0], &pz[0], &e[0], &px[1], &py[1], &pz[1], &e[1], &mjj);
+    PseudoJet jj = jets[0] + jets[1];
+    d_mjj.add(mjj, jj.m(), jj.e()*jj.e()/max(fabs(jj.m()), 1.));
+
+    double mt, e_sum = met + e[0] + e[1], pz_sum = pz[0] + pz[1];
+    kin_mperp(1, &e_sum, &pz_sum, &mt);
+    PseudoJet sum = MEt + jets[0] + jets[1];
+    d_mt.add(mt, sum.mperp(), sum.e()*sum.e()/max(sum.mperp(), 1.));
+  }
+
+  Deviation* all[] = {&d_phi, &d_y, &d_mjj, &d_mt, &d_dphi};
+  bool ok = true;
+  cout<<n<<" events, tolerance "<<tol<<endl;
+  for(size_t q=0; q<sizeof(all)/sizeof(all[0]); ++q){
+    bool pass = all[q]->max_dev <= tol;
+    ok = ok && pass;
+    cout<<setw(6)<<all[q]->name<<"  max deviation "<<setw(12)<<all[q]->max_dev
+        <<" at "<<setw(12)<<all[q]->at_value<<"  "<<(pass ? "OK" : "FAIL")<<endl;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,725 @@
+#ifndef __lhe_reader_h
+#define __lhe_reader_h
+
+// LHE ingestion for -m lhe
+//
+// Instead of letting Pythia read Beams:LHEF from the start, the file
+// is indexed once (byte offset of every <event> block, cached next to
+// the file as <file>.idx) and Pythia is handed a stream made of the
+// header followed by events [first, last) only.  Plain files are
+// memory-mapped and served without copies; .lhe.gz files are
+// decompressed by a prefetch thread (needs GZIPSUPPORT, as in Pythia).
+//
+// The stream goes through LHAupLHEF, so user hooks such as the
+// CombineMatchingInput matching keep working as with Beams:LHEF.
+//
+// Input can also be streamed from a producer, "-" for stdin or a
+// FIFO: no index is built and the number of events is unknown until
+// the end of the stream.  Only a few chunks are buffered ahead, so a
+// slow consumer makes the pipe fill up and blocks the producer.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef GZIPSUPPORT
+#include <zlib.h>
+#endif
+
+#include "Pythia8/Pythia.h"
+
+using namespace std;
+
+
+// Byte offsets of the <event> blocks (in the decompressed stream)
+struct LHEIndex {
+
+  uint64_t file_size;
+  int64_t mtime;
+
+  // end of the header, i.e. first <event>
+  uint64_t header_end;
+  // </LesHouchesEvents>, or end of file if truncated
+  uint64_t footer_begin;
+
+  vector<uint64_t> offsets;
+
+  LHEIndex(): file_size(0), mtime(0), header_end(0), footer_begin(0) {}
+
+  long size() const {return long(offsets.size());}
+
+  // First byte of event i, the footer for i == size()
+  uint64_t event_begin(long i) const {
+    return i < size() ? offsets[i] : footer_begin;
+  }
+
+  bool read(const string& fname, uint64_t fsize, int64_t ftime){
+    ifstream fin(fname.c_str(), ios::binary);
+    char magic[8];
+    uint64_t n = 0;
+    if(!fin.read(magic, 8) || memcmp(magic, "LHEIDX1", 8) != 0)
+      return false;
+    fin.read((char*) &file_size, sizeof(file_size));
+    fin.read((char*) &mtime, sizeof(mtime));
+    fin.read((char*) &header_end, sizeof(header_end));
+    fin.read((char*) &footer_begin, sizeof(footer_begin));
+    fin.read((char*) &n, sizeof(n));
+    if(!fin || file_size != fsize || mtime != ftime)
+      return false;
+    offsets.resize(n);
+    fin.read((char*) offsets.data(), n*sizeof(uint64_t));
+    return bool(fin);
+  }
+
+  bool write(const string& fname) const {
+    ofstream fout(fname.c_str(), ios::binary);
+    if(!fout.good())
+      return false;
+    uint64_t n = offsets.size();
+    fout.write("LHEIDX1", 8);
+    fout.write((const char*) &file_size, sizeof(file_size));
+    fout.write((const char*) &mtime, sizeof(mtime));
+    fout.write((const char*) &header_end, sizeof(header_end));
+    fout.write((const char*) &footer_begin, sizeof(footer_begin));
+    fout.write((const char*) &n, sizeof(n));
+    fout.write((const char*) offsets.data(), n*sizeof(uint64_t));
+    return fout.good();
+  }
+};
+
+
+// Incremental tag scanner, fed with consecutive pieces of the file.
+// Events are only looked for after </init>, so the header can hold
+// anything.
+class LHEScanner {
+
+public:
+
+  LHEIndex& index;
+
+  LHEScanner(LHEIndex& index): index(index), base(0), in_events(false),
+    found_footer(false) {}
+
+  void feed(const char* data, size_t n){
+    pending.insert(pending.end(), data, data + n);
+    size_t used = scan(pending.empty() ? NULL : &pending[0], pending.size(), false);
+    pending.erase(pending.begin(), pending.begin() + used);
+  }
+
+  // Scan a whole file already in memory, no copies
+  uint64_t feed_all(const char* data, size_t n){
+    scan(data, n, true);
+    return finish();
+  }
+
+  // Flush the last bytes, returns the total length seen
+  uint64_t finish(){
+    if(!pending.empty())
+      scan(&pending[0], pending.size(), true);
+    pending.clear();
+    uint64_t total = base;
+    if(!found_footer)
+      index.footer_begin = total;
+    if(index.offsets.empty())
+      index.header_end = index.footer_begin;
+    return total;
+  }
+
+private:
+
+  // longest tag we look for
+  static const size_t tag_max = 20;
+
+  vector<char> pending;
+  uint64_t base;
+  bool in_events;
+  bool found_footer;
+
+  static bool match(const char* p, size_t n, const char* tag){
+    size_t len = strlen(tag);
+    return n >= len && memcmp(p, tag, len) == 0;
+  }
+
+  // Returns the number of bytes fully scanned, the rest could still
+  // be the start of a tag
+  size_t scan(const char* data, size_t n, bool final){
+    size_t limit = final ? n : (n > tag_max ? n - tag_max : 0);
+
+    size_t i = 0;
+    while(i < limit){
+      const char* p = (const char*) memchr(data + i, '<', limit - i);
+      if(!p)
+        break;
+      i = p - data;
+      size_t left = n - i;
+
+      if(!in_events){
+        if(match(p, left, "</init>"))
+          in_events = true;
+      }
+      else if(match(p, left, "<event") && left > 6 &&
+              (p[6] == '>' || p[6] == ' ' || p[6] == '\n' || p[6] == '\t')){
+        if(index.offsets.empty())
+          index.header_end = base + i;
+        index.offsets.push_back(base + i);
+      }
+      else if(match(p, left, "</LesHouchesEvents>")){
+        index.footer_begin = base + i;
+        found_footer = true;
+      }
+      ++i;
+    }
+
+    base += limit;
+    return limit;
+  }
+};
+
+
+// Read-only memory map of a whole file
+class MappedFile {
+
+public:
+
+  const char* data;
+  size_t size;
+
+  MappedFile(): data(NULL), size(0), fd(-1) {}
+  ~MappedFile(){ close(); }
+
+  bool open(const string& fname){
+    fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+      return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+      return false;
+    size = st.st_size;
+    if(size == 0)
+      return true;
+    void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(ptr == MAP_FAILED){
+      size = 0;
+      return false;
+    }
+    data = (const char*) ptr;
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  // Ask the kernel to start reading a region ahead of time
+  void prefetch(uint64_t begin, uint64_t end) const {
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t aligned = begin - begin % page;
+    if(data && end > aligned)
+      madvise((void*) (data + aligned), end - aligned, MADV_WILLNEED);
+  }
+
+  void close(){
+    if(data)
+      munmap((void*) data, size);
+    if(fd >= 0)
+      ::close(fd);
+    data = NULL;
+    fd = -1;
+  }
+
+private:
+
+  int fd;
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+
+// streambuf over a list of memory regions, served without copies
+class SegmentBuf : public streambuf {
+
+public:
+
+  SegmentBuf(): iseg(0) {}
+
+  void add(const char* begin, size_t n){
+    segs.push_back(make_pair(begin, n));
+  }
+
+  // Change a region that has not been started yet
+  bool replace(size_t i, const char* begin, size_t n){
+    if(i < iseg || i >= segs.size())
+      return false;
+    segs[i] = make_pair(begin, n);
+    return true;
+  }
+
+protected:
+
+  int_type underflow(){
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+    while(iseg < segs.size() && segs[iseg].second == 0)
+      ++iseg;
+    if(iseg >= segs.size())
+      return traits_type::eof();
+    char* p = const_cast<char*>(segs[iseg].first);
+    setg(p, p, p + segs[iseg].second);
+    ++iseg;
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+
+  vector<pair<const char*, size_t> > segs;
+  size_t iseg;
+};
+
+
+// Sequential source of bytes for the prefetch thread
+class ByteSource {
+public:
+  virtual ~ByteSource() {}
+  // Fill buf with up to n bytes; 0 at end of input, -1 on error
+  virtual long read(char* buf, size_t n) = 0;
+  // Hand over data as soon as it arrives instead of filling chunks
+  virtual bool streaming() const {return false;}
+};
+
+// Pipe, FIFO or stdin
+class FdSource : public ByteSource {
+public:
+  FdSource(int fd): fd(fd) {}
+  ~FdSource(){ if(fd > 0) close(fd); }
+  long read(char* buf, size_t n){
+    long got;
+    do {
+      got = ::read(fd, buf, n);
+    } while(got < 0 && errno == EINTR);
+    return got;
+  }
+  bool streaming() const {return true;}
+private:
+  int fd;
+};
+
+#ifdef GZIPSUPPORT
+class GzSource : public ByteSource {
+public:
+  GzSource(): gz(NULL) {}
+  ~GzSource(){ if(gz) gzclose(gz); }
+  bool open(const string& fname){
+    gz = gzopen(fname.c_str(), "rb");
+    if(gz)
+      gzbuffer(gz, 1<<20);
+    return gz != NULL;
+  }
+  long read(char* buf, size_t n){
+    return gzread(gz, buf, (unsigned) n);
+  }
+private:
+  gzFile gz;
+};
+#endif
+
+// Passes through only the byte ranges [begin, end) of another
+// source, then appends a fixed trailer
+class RangeSource : public ByteSource {
+
+public:
+
+  RangeSource(ByteSource* src, const vector<pair<uint64_t, uint64_t> >& ranges,
+              const string& trailer):
+    src(src), ranges(ranges), trailer(trailer), pos(0), irange(0),
+    trailer_pos(0), buf(1<<20), buf_begin(0), buf_pos(0), buf_len(0) {}
+
+  ~RangeSource(){ delete src; }
+
+  long read(char* out, size_t n){
+    while(irange < ranges.size()){
+      uint64_t begin = ranges[irange].first, end = ranges[irange].second;
+
+      // refill the staging buffer
+      if(buf_pos >= buf_len){
+        long got = src->read(&buf[0], buf.size());
+        if(got < 0)
+          return -1;
+        if(got == 0)
+          break;
+        buf_begin = pos;
+        buf_pos = 0;
+        buf_len = got;
+        pos += got;
+      }
+
+      uint64_t cur = buf_begin + buf_pos;
+      uint64_t buf_end = buf_begin + buf_len;
+
+      if(cur >= end){ ++irange; continue; }
+      if(buf_end <= begin){ buf_pos = buf_len; continue; }
+      if(cur < begin){ buf_pos = begin - buf_begin; cur = begin; }
+
+      size_t take = min<uint64_t>(n, min(end, buf_end) - cur);
+      memcpy(out, &buf[buf_pos], take);
+      buf_pos += take;
+      return take;
+    }
+
+    size_t take = min(n, trailer.size() - trailer_pos);
+    memcpy(out, trailer.data() + trailer_pos, take);
+    trailer_pos += take;
+    return take;
+  }
+
+private:
+
+  ByteSource* src;
+  vector<pair<uint64_t, uint64_t> > ranges;
+  string trailer;
+  uint64_t pos;
+  size_t irange, trailer_pos;
+
+  vector<char> buf;
+  uint64_t buf_begin;
+  size_t buf_pos, buf_len;
+};
+
+
+// streambuf fed by a background thread reading a ByteSource into a
+// small ring of chunks; the reader blocks when all chunks are full
+class PrefetchBuf : public streambuf {
+
+public:
+
+  PrefetchBuf(ByteSource* src, size_t chunk_size = 1<<22, int nchunk = 4):
+    src(src), chunks(nchunk, vector<char>(chunk_size)), lengths(nchunk, 0),
+    current(-1), done(false), stop(false), failed(false), n_stall(0),
+    n_blocked(0), n_bytes(0)
+  {
+    for(int i=0; i<nchunk; ++i)
+      free_chunks.push_back(i);
+    worker = thread(&PrefetchBuf::run, this);
+  }
+
+  ~PrefetchBuf(){
+    {
+      lock_guard<mutex> lock(mtx);
+      stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+    delete src;
+  }
+
+  // times the consumer had to wait for input
+  long stalls() const {return n_stall;}
+  // times the reader thread had to wait for the consumer
+  long blocked() const {return n_blocked;}
+  uint64_t bytes() const {return n_bytes;}
+  bool error() const {return failed;}
+
+protected:
+
+  int_type underflow(){
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    unique_lock<mutex> lock(mtx);
+    if(current >= 0){
+      free_chunks.push_back(current);
+      current = -1;
+      cv.notify_all();
+    }
+    if(full_chunks.empty() && !done)
+      ++n_stall;
+    cv.wait(lock, [this]{ return !full_chunks.empty() || done; });
+    if(full_chunks.empty())
+      return traits_type::eof();
+
+    current = full_chunks.front();
+    full_chunks.pop_front();
+    char* p = &chunks[current][0];
+    setg(p, p, p + lengths[current]);
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+
+  ByteSource* src;
+  vector<vector<char> > chunks;
+  vector<size_t> lengths;
+  deque<int> free_chunks, full_chunks;
+  int current;
+
+  mutex mtx;
+  condition_variable cv;
+  thread worker;
+  bool done, stop, failed;
+  long n_stall, n_blocked;
+  uint64_t n_bytes;
+
+  void run(){
+    while(true){
+      int ichunk;
+      {
+        unique_lock<mutex> lock(mtx);
+        if(free_chunks.empty())
+          ++n_blocked;
+        cv.wait(lock, [this]{ return !free_chunks.empty() || stop; });
+        if(stop)
+          break;
+        ichunk = free_chunks.front();
+        free_chunks.pop_front();
+      }
+
+      // fill the whole chunk unless the input runs out, streams are
+      // handed over as soon as something arrives
+      size_t filled = 0;
+      long got = 1;
+      vector<char>& chunk = chunks[ichunk];
+      while(filled < chunk.size() &&
+            (got = src->read(&chunk[filled], chunk.size() - filled)) > 0){
+        filled += got;
+        if(src->streaming())
+          break;
+      }
+
+      lock_guard<mutex> lock(mtx);
+      n_bytes += filled;
+      if(got < 0)
+        failed = true;
+      if(filled > 0){
+        lengths[ichunk] = filled;
+        full_chunks.push_back(ichunk);
+      }
+      else
+        free_chunks.push_back(ichunk);
+      if(got <= 0){
+        done = true;
+        cv.notify_all();
+        break;
+      }
+      cv.notify_all();
+    }
+  }
+};
+
+
+// Closing tag appended after the selected events
+const char* const lhe_footer = "</LesHouchesEvents>\n";
+
+// Split n events into nshard contiguous blocks, return block ishard
+void shard_range(long n, int ishard, int nshard, long& first, long& last){
+  first = n * ishard / nshard;
+  last = n * (ishard + 1) / nshard;
+}
+
+
+// An LHE file opened for Pythia, restricted to events [first, last)
+class LHEInput {
+
+public:
+
+  LHEIndex index;
+  long first, last;
+
+  LHEInput(): first(0), last(0), gzipped(false), streaming(false), fd(-1),
+    buf(NULL), is(NULL) {}
+  ~LHEInput(){ delete is; delete buf; }
+
+  // "-" (stdin) or a FIFO, read as a stream
+  static bool is_stream(const string& fname){
+    struct stat st;
+    return fname == "-" ||
+      (stat(fname.c_str(), &st) == 0 && S_ISFIFO(st.st_mode));
+  }
+
+  // Open a stream, there is no index and the events cannot be selected
+  bool open_stream(const string& fname){
+    filename = fname;
+    streaming = true;
+    fd = fname == "-" ? 0 : ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0){
+      cerr<<"ERROR: cannot open LHE stream "<<fname<<endl;
+      return false;
+    }
+    cout<<"INFO: streaming LHE events from "
+        <<(fname == "-" ? "stdin" : fname)<<endl;
+    return true;
+  }
+
+  bool is_streaming() const {return streaming;}
+
+  // Buffering statistics of the stream, for the log
+  void print_stream_stats(ostream& out) const {
+    const PrefetchBuf* pbuf = dynamic_cast<const PrefetchBuf*>(buf);
+    if(!pbuf)
+      return;
+    out<<"INFO: read "<<pbuf->bytes()/1048576.<<" MB of LHE input, "
+       <<"waited "<<pbuf->stalls()<<" times for the producer, "
+       <<"held back the producer "<<pbuf->blocked()<<" times"<<endl;
+    if(pbuf->error())
+      out<<"WARNING: error while reading the LHE input"<<endl;
+  }
+
+  // Build or load the event index of fname
+  bool open(const string& fname, const string& index_name = ""){
+    filename = fname;
+    gzipped = fname.size() > 3 && fname.compare(fname.size() - 3, 3, ".gz") == 0;
+
+#ifndef GZIPSUPPORT
+    // with or without an index, there would be nothing to read it with
+    if(gzipped){
+      cerr<<"ERROR: "<<fname<<" is gzipped but GZIPSUPPORT is off"<<endl;
+      return false;
+    }
+#endif
+
+    struct stat st;
+    if(stat(fname.c_str(), &st) != 0){
+      cerr<<"ERROR: cannot open LHE file "<<fname<<endl;
+      return false;
+    }
+
+    string idx_name = index_name == "" ? fname + ".idx" : index_name;
+    if(index.read(idx_name, st.st_size, st.st_mtime)){
+      cout<<"INFO: read LHE index "<<idx_name<<", "
+          <<index.size()<<" events"<<endl;
+      select(0);
+      return gzipped || map.open(fname);
+    }
+
+    index = LHEIndex();
+    index.file_size = st.st_size;
+    index.mtime = st.st_mtime;
+    LHEScanner scanner(index);
+
+    if(gzipped){
+#ifdef GZIPSUPPORT
+      GzSource gz;
+      if(!gz.open(fname)){
+        cerr<<"ERROR: cannot open LHE file "<<fname<<endl;
+        return false;
+      }
+      vector<char> chunk(1<<22);
+      long got;
+      while((got = gz.read(&chunk[0], chunk.size())) > 0)
+        scanner.feed(&chunk[0], got);
+      if(got < 0){
+        cerr<<"ERROR: corrupt gzip file "<<fname<<endl;
+        return false;
+      }
+#endif
+    }
+    else {
+      if(!map.open(fname)){
+        cerr<<"ERROR: cannot map LHE file "<<fname<<endl;
+        return false;
+      }
+      scanner.feed_all(map.data, map.size);
+    }
+    if(gzipped)
+      scanner.finish();
+
+    cout<<"INFO: indexed "<<index.size()<<" LHE events in "<<fname<<endl;
+
+    if(!index.write(idx_name))
+      cout<<"WARNING: cannot write LHE index "<<idx_name<<endl;
+    select(0);
+    return true;
+  }
+
+  // Select the events to serve, last < 0 means up to the end
+  void select(long first_, long last_ = -1){
+    first = min(max(first_, 0L), index.size());
+    last = (last_ < 0 || last_ > index.size()) ? index.size() : last_;
+    if(last < first)
+      last = first;
+  }
+
+  long n_selected() const {return last - first;}
+
+  bool can_restrict() const {
+    return !streaming && !gzipped;
+  }
+
+  // Narrow the selection once Pythia has read the header, e.g. in a
+  // forked worker.  Only possible for memory-mapped files.
+  bool restrict(long first_, long last_){
+    SegmentBuf* segbuf = dynamic_cast<SegmentBuf*>(buf);
+    if(!segbuf)
+      return false;
+    select(first_, last_);
+    uint64_t ev_begin = index.event_begin(first);
+    uint64_t ev_end = index.event_begin(last);
+    map.prefetch(ev_begin, ev_end);
+    return segbuf->replace(1, map.data + ev_begin, ev_end - ev_begin);
+  }
+
+  // Stream of header + selected events + closing tag
+  istream* stream(){
+    if(is)
+      return is;
+
+    if(streaming){
+      // 16 x 256 kB in flight at most
+      buf = new PrefetchBuf(new FdSource(fd), 1<<18, 16);
+      is = new istream(buf);
+      return is;
+    }
+
+    uint64_t ev_begin = index.event_begin(first);
+    uint64_t ev_end = index.event_begin(last);
+
+    if(gzipped){
+#ifdef GZIPSUPPORT
+      GzSource* gz = new GzSource();
+      gz->open(filename);
+      vector<pair<uint64_t, uint64_t> > ranges;
+      ranges.push_back(make_pair(uint64_t(0), index.header_end));
+      ranges.push_back(make_pair(ev_begin, ev_end));
+      buf = new PrefetchBuf(new RangeSource(gz, ranges, lhe_footer));
+#endif
+    }
+    else {
+      SegmentBuf* segbuf = new SegmentBuf();
+      segbuf->add(map.data, index.header_end);
+      segbuf->add(map.data + ev_begin, ev_end - ev_begin);
+      segbuf->add(lhe_footer, strlen(lhe_footer));
+      map.prefetch(ev_begin, ev_end);
+      buf = segbuf;
+    }
+
+    is = new istream(buf);
+    return is;
+  }
+
+  // Reader for Pythia, to be used with Beams:frameType = 5
+  LHAup* make_lhaup(Pythia& pythia){
+    return new LHAupLHEF(&pythia.info, stream(), NULL,
+                         pythia.settings.flag("Beams:readLHEFheaders"));
+  }
+
+private:
+
+  string filename;
+  bool gzipped;
+  bool streaming;
+  int fd;
+  MappedFile map;
+  streambuf* buf;
+  istream* is;};
+
+#endif
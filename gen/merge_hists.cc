@@ -0,0 +1,104 @@
+// Merge histogram files written by monojet.exe -hist across jobs
+//
+// Usage: merge_hists -o merged.hist.json job1.hist.json job2.hist.json ...
+//        merge_hists -o merged.hist.json -l list_of_files.txt
+//
+// Bin contents and event counts are summed; the cross-sections stored
+// in the info block are combined weighted by their errors.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include "CmdLine/CmdLine.hh"
+#include "histograms.h"
+#include "cxn_combine.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  string output = cmdline.value<string>("-o", "merged.hist.json");
+
+  vector<string> inputs;
+
+  // files given on a list, one per line
+  if(cmdline.present("-l")){
+    ifstream flist(cmdline.value<string>("-l").c_str());
+    string name;
+    while(flist >> name)
+      inputs.push_back(name);
+  }
+
+  // remaining arguments that are neither options nor their values
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    inputs.push_back(args[i]);
+  }
+
+  if(inputs.empty()){
+    cerr<<"Usage: merge_hists -o (output) [-l (file list)] file1 file2 ..."<<endl;
+    return 1;
+  }
+
+  HistogramSet merged;
+  vector<pair<string, double> > merged_info;
+
+  CxnCombiner combined;
+
+  for(size_t i=0; i<inputs.size(); ++i){
+
+    HistogramSet hists;
+    vector<pair<string, double> > info;
+
+    if(!hists.read_json(inputs[i], &info)){
+      cerr<<"ERROR: cannot read histograms from "<<inputs[i]<<", exiting..."<<endl;
+      return 1;
+    }
+
+    if(i == 0)
+      merged = hists;
+    else if(!merged.add(hists)){
+      cerr<<"ERROR: "<<inputs[i]<<" has a different booking than "
+          <<inputs[0]<<", exiting..."<<endl;
+      return 1;
+    }
+
+    double cxn = 0, cxn_err = 0, nevt = 0;
+    for(size_t j=0; j<info.size(); ++j){
+      if(info[j].first == "cxn") cxn = info[j].second;
+      else if(info[j].first == "cxn_err") cxn_err = info[j].second;
+      else {
+        if(info[j].first == "nevt") nevt = info[j].second;
+
+        // everything else is an additive count
+        size_t k = 0;
+        while(k < merged_info.size() && merged_info[k].first != info[j].first)
+          ++k;
+        if(k == merged_info.size())
+          merged_info.push_back(make_pair(info[j].first, 0.0));
+        merged_info[k].second += info[j].second;
+      }
+    }
+
+    combined.add(cxn, cxn_err, nevt);
+  }
+
+  if(!combined.empty()){
+    merged_info.push_back(make_pair("cxn", combined.cxn()));
+    merged_info.push_back(make_pair("cxn_err", combined.err()));
+  }
+
+  if(!merged.write_json(output, merged_info))
+    return 1;
+
+  cout<<"INFO: merged "<<inputs.size()<<" files into "<<output<<endl;
+  return 0;
+}
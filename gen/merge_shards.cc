@@ -0,0 +1,103 @@
+// Merge the outputs of sharded monojet.exe runs of one point
+//
+// Usage: merge_shards -o merged [-columnar] [-j (threads)] shard0 shard1 ...
+//        merge_shards -o merged [-columnar] [-j (threads)] -l list_of_shards.txt
+//
+// Shards are given by their output name (or the name of their .evt).
+// merged.meta sums nevt, npass and sum_weight and combines the cross
+// sections weighted by their errors; merged.evt concatenates the rows
+// with the evt column renumbered, or with -columnar merged.evtc holds
+// the same table column by column (see evt_merge.h).  merged.hist.json
+// and merged.objs are written when all shards have them.  The shards
+// are read through mmap, -j of them at a time.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <chrono>
+
+#include "CmdLine/CmdLine.hh"
+#include "shard_merge.h"
+
+using namespace std;
+
+bool all_exist(const vector<string>& bases, const string& ext){
+  for(size_t i=0; i<bases.size(); ++i)
+    if(!ifstream((bases[i] + ext).c_str()).good())
+      return false;
+  return true;
+}
+
+vector<string> with_ext(const vector<string>& bases, const string& ext){
+  vector<string> files;
+  for(size_t i=0; i<bases.size(); ++i)
+    files.push_back(bases[i] + ext);
+  return files;
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  string output = cmdline.value<string>("-o", "merged");
+  bool columnar = cmdline.present("-columnar");
+  int nthread = cmdline.value<int>("-j", thread::hardware_concurrency());
+
+  vector<string> bases;
+
+  // shards given on a list, one per line
+  if(cmdline.present("-l")){
+    ifstream flist(cmdline.value<string>("-l").c_str());
+    string name;
+    while(flist >> name)
+      bases.push_back(name);
+  }
+
+  // remaining arguments that are neither options nor their values
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i] == "-columnar")
+      continue;
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    bases.push_back(args[i]);
+  }
+
+  for(size_t i=0; i<bases.size(); ++i)
+    if(bases[i].size() > 4 && bases[i].substr(bases[i].size() - 4) == ".evt")
+      bases[i] = bases[i].substr(0, bases[i].size() - 4);
+
+  if(bases.empty()){
+    cerr<<"Usage: merge_shards -o (output) [-columnar] [-j (threads)] [-l (shard list)] shard1 shard2 ..."<<endl;
+    return 1;
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  vector<pair<string, double> > info;
+  if(!merge_meta(with_ext(bases, ".meta"), output + ".meta", info))
+    return 1;
+
+  if(all_exist(bases, ".evt") &&
+     !merge_evt_files(with_ext(bases, ".evt"), output + (columnar ? ".evtc" : ".evt"),
+                      columnar, nthread))
+    return 1;
+
+  if(all_exist(bases, ".hist.json") &&
+     !merge_hists(with_ext(bases, ".hist.json"), output + ".hist.json", info))
+    return 1;
+
+  if(all_exist(bases, ".objs") &&
+     !merge_store(with_ext(bases, ".objs"), output + ".objs", info))
+    return 1;
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout<<"INFO: merged "<<bases.size()<<" shards into "<<output<<", "
+      <<info[0].second<<" events, "<<info[1].second<<" passed, "
+      <<seconds<<" s"<<endl;
+  return 0;
+}
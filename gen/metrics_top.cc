@@ -0,0 +1,249 @@
+// Summary of the running monojet.exe jobs of a node, from their -metrics
+//
+// Usage: metrics_top [-socket path] [-every (10)] [-stale (60)] [-slow (0.5)] [-once] [files...]
+//
+// Collects the JSON lines of run_metrics.h, from datagrams on the Unix
+// socket path (jobs run with -metrics unix:path) and from the files
+// given (jobs run with -metrics file, read from their start and then
+// followed), and every -every seconds prints one row per job, keeping
+// only the last line of each host, pid and worker, then the totals.
+// Flags:
+//
+//   STALLED   running, but its last line is -stale seconds old
+//   SLOW      running below -slow times the median rate of the jobs
+//             with the same target kind
+//
+// -once prints the files' table once and exits.  Ends on SIGINT or
+// SIGTERM, removing the socket.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "CmdLine/CmdLine.hh"
+#include "json_lite.h"
+#include "run_metrics.h"
+
+using namespace std;
+
+static volatile sig_atomic_t quit = 0;
+
+void quit_handler(int){quit = 1;}
+
+// Last line of each job
+typedef map<string, JsonValue> JobTable;
+
+void add_line(JobTable& jobs, const string& text){
+  JsonValue line;
+  if(!json_parse(text, line) || line.type != JsonValue::Object)
+    return;
+  ostringstream key;
+  key << line.text("host") << "/" << long(line.num("pid")) << "/" << long(line.num("worker", -1));
+  jobs[key.str()] = line;
+}
+
+// A metrics file, read line by line as it grows
+struct FollowedFile {
+  string name;
+  ifstream in;
+  string partial;
+
+  void read(JobTable& jobs){
+    if(!in.is_open()){
+      in.open(name.c_str());
+      if(!in.is_open())
+        return;
+    }
+    string text;
+    while(getline(in, text)){
+      if(in.eof()){
+        // no newline yet: the rest of the line comes later
+        partial += text;
+        break;
+      }
+      add_line(jobs, partial + text);
+      partial.clear();
+    }
+    in.clear();
+  }
+};
+
+double median(vector<double> values){
+  if(values.empty())
+    return 0;
+  sort(values.begin(), values.end());
+  return values[values.size()/2];
+}
+
+void print_table(const JobTable& jobs, double stale, double slow){
+  time_t now = time(NULL);
+
+  // median rates, for the SLOW flag
+  map<string, vector<double> > rates;
+  for(JobTable::const_iterator it=jobs.begin(); it!=jobs.end(); ++it){
+    const JsonValue& line = it->second;
+    if(line.text("status") == "running")
+      rates[line.text("target_kind")].push_back(line.num("rate_tried"));
+  }
+
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  cout << "# " << stamp << ", " << jobs.size() << " jobs\n";
+  cout << left << setw(24) << "job" << setw(12) << "host" << right << setw(8) << "pid"
+       << setw(4) << "w" << " " << left << setw(12) << "status" << right
+       << setw(11) << "tried" << setw(10) << "pass" << setw(7) << "done%"
+       << setw(9) << "evt/s" << setw(16) << "eff" << setw(12) << "ETA"
+       << setw(8) << "gen_ms" << setw(8) << "det_ms" << setw(8) << "sel_ms"
+       << setw(8) << "rss_mb" << setw(6) << "errs" << setw(6) << "age" << "  flags\n";
+
+  long n_running = 0, n_stalled = 0, n_slow = 0, tried = 0, pass = 0;
+  double rate = 0;
+  for(JobTable::const_iterator it=jobs.begin(); it!=jobs.end(); ++it){
+    const JsonValue& line = it->second;
+    double age = difftime(now, time_t(line.num("time", now)));
+    string status = line.text("status");
+    bool running = status == "running";
+    double target = line.num("target");
+    double done = line.text("target_kind") == "tried" ? line.num("n_tried") : line.num("n_pass");
+    double eta = line.num("eta_sec", -1);
+
+    string flags;
+    if(running && age > stale){
+      flags += "STALLED ";
+      ++n_stalled;
+    }
+    double typical = median(rates[line.text("target_kind")]);
+    if(running && typical > 0 && line.num("rate_tried") < slow*typical){
+      flags += "SLOW ";
+      ++n_slow;
+    }
+
+    const JsonValue* stage = line.get("sec_per_evt");
+    double gen_ms = stage ? 1e3*stage->num("generation") : 0;
+    double det_ms = stage ? 1e3*stage->num("detector") : 0;
+    double sel_ms = stage ? 1e3*stage->num("selection") : 0;
+
+    ostringstream eff;
+    eff << setprecision(3) << line.num("eff") << "+-" << setprecision(2) << line.num("eff_err");
+
+    cout << left << setw(24) << line.text("job").substr(0, 23)
+         << setw(12) << line.text("host").substr(0, 11) << right
+         << setw(8) << long(line.num("pid")) << setw(4) << long(line.num("worker", -1)) << " "
+         << left << setw(12) << status << right
+         << setw(11) << long(line.num("n_tried")) << setw(10) << long(line.num("n_pass"))
+         << fixed << setprecision(1) << setw(7) << (target > 0 ? 100*done/target : 0.)
+         << setw(9) << line.num("rate_tried") << defaultfloat
+         << setw(16) << eff.str()
+         << setw(12) << (!running ? "-" : eta >= 0 ? duration_text(eta) : "?")
+         << fixed << setprecision(2) << setw(8) << gen_ms << setw(8) << det_ms << setw(8) << sel_ms
+         << setprecision(0) << setw(8) << line.num("rss_mb") << defaultfloat
+         << setw(6) << long(line.num("gen_errors")) << setw(6) << long(age)
+         << "  " << flags << "\n";
+
+    if(running){
+      ++n_running;
+      rate += line.num("rate_tried");
+    }
+    tried += line.num("n_tried");
+    pass += line.num("n_pass");
+  }
+
+  cout << "# " << n_running << " running, " << n_stalled << " stalled, " << n_slow
+       << " slow; " << tried << " tried, " << pass << " accepted, "
+       << fixed << setprecision(1) << rate << " evt/s" << defaultfloat << "\n" << endl;
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  string socket_path = cmdline.value<string>("-socket", "");
+  double every = cmdline.value<double>("-every", 10);
+  double stale = cmdline.value<double>("-stale", 60);
+  double slow = cmdline.value<double>("-slow", 0.5);
+  bool once = cmdline.present("-once");
+
+  // metrics files: the arguments that are neither options nor values
+  vector<FollowedFile> files;
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i] == "-once")
+      continue;
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    files.push_back(FollowedFile());
+    files.back().name = args[i];
+  }
+
+  if(files.empty() && socket_path == ""){
+    cerr<<"Usage: metrics_top [-socket path] [-every (10)] [-stale (60)] [-slow (0.5)] [-once] [files...]"<<endl;
+    return 1;
+  }
+
+  JobTable jobs;
+  if(once){
+    for(size_t f=0; f<files.size(); ++f)
+      files[f].read(jobs);
+    print_table(jobs, stale, slow);
+    return 0;
+  }
+
+  int fd = -1;
+  if(socket_path != ""){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if(fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0){
+      cerr<<"ERROR: cannot listen on "<<socket_path<<": "<<strerror(errno)<<endl;
+      return 1;
+    }
+    cout<<"INFO: listening on "<<socket_path<<endl;
+  }
+
+  signal(SIGINT, quit_handler);
+  signal(SIGTERM, quit_handler);
+
+  vector<char> buffer(65536);
+  time_t next_print = time(NULL) + time_t(every);
+  while(!quit){
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if(fd >= 0 && poll(&pfd, 1, 200) > 0)
+      for(ssize_t n; (n = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT)) > 0; )
+        add_line(jobs, string(buffer.data(), n));
+    else if(fd < 0)
+      usleep(200000);
+
+    for(size_t f=0; f<files.size(); ++f)
+      files[f].read(jobs);
+
+    if(time(NULL) >= next_print){
+      print_table(jobs, stale, slow);
+      next_print = time(NULL) + time_t(every);
+    }
+  }
+
+  if(fd >= 0){
+    close(fd);
+    unlink(socket_path.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,143 @@
+#ifndef __multiproc_h
+#define __multiproc_h
+
+// Fork-after-init multi-process mode (-procs N)
+//
+// Pythia, Delphes and ROOT are set up once in the parent, which then
+// forks N workers sharing all of that memory copy-on-write.  Each
+// worker generates its share of the events into its own part files
+// and reports its counters through a shared memory block; the parent
+// waits for all of them and merges the parts into the usual
+// .evt/.meta output.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+
+using namespace std;
+
+// Most detector cards run on the same events (-detector)
+#define WORKER_MAX_DETECTORS 8
+
+// What a worker reports back to the parent
+struct WorkerResult {
+  long n_total;       // tried events
+  long n_pass;        // accepted events
+  long n_pass_detector[WORKER_MAX_DETECTORS];
+  double sigma_gen;   // Pythia cross section estimate (mb)
+  double sigma_err;
+  double weight_sum;
+  long mult_sum;      // generated particles
+  long n_over_budget; // tried events over the per-event budget
+  int run_status;     // RunStatus of its share
+  int lhe_eof;        // reached the end of its LHE events
+  int done;           // set last, once the rest is filled
+};
+
+class WorkerPool {
+
+public:
+
+  int nworker;
+  WorkerResult* results;
+
+  WorkerPool(): nworker(0), results(NULL) {}
+
+  ~WorkerPool(){
+    if(results)
+      munmap(results, nworker*sizeof(WorkerResult));
+  }
+
+  // Fork n workers: returns the worker number in the children and
+  // -1 in the parent, or -2 on error
+  int fork_workers(int n){
+    nworker = n;
+    void* ptr = mmap(NULL, n*sizeof(WorkerResult), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED){
+      cerr<<"ERROR: cannot allocate shared memory for workers"<<endl;
+      return -2;
+    }
+    results = (WorkerResult*) ptr;
+    memset(results, 0, n*sizeof(WorkerResult));
+
+    // do not let the children inherit half-written buffers
+    cout.flush();
+    cerr.flush();
+    fflush(NULL);
+
+    for(int i=0; i<n; ++i){
+      pid_t pid = fork();
+      if(pid < 0){
+        cerr<<"ERROR: fork failed for worker "<<i<<endl;
+        return -2;
+      }
+      if(pid == 0)
+        return i;
+      pids.push_back(pid);
+    }
+    cout<<"INFO: forked "<<n<<" workers"<<endl;
+    return -1;
+  }
+
+  // Number of events for worker i out of n
+  static long share(long n, int i, int nworker){
+    return n/nworker + (i < n % nworker ? 1 : 0);
+  }
+
+  // Wait for all workers, false if any of them failed
+  bool wait_all(){
+    bool ok = true;
+    for(size_t i=0; i<pids.size(); ++i){
+      int status = 0;
+      while(waitpid(pids[i], &status, 0) < 0 && errno == EINTR)
+        ;
+      if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !results[i].done){
+        cerr<<"ERROR: worker "<<i<<" failed"<<endl;
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  const vector<pid_t>& worker_pids() const {return pids;}
+
+  static string part_name(const string& base, int i, const string& ext){
+    return base + ".part" + to_string(i) + ext;
+  }
+
+private:
+
+  vector<pid_t> pids;
+};
+
+// Append the rows of a .evt part, renumbering the evt column so that
+// ids stay unique in the merged file; skip_header for complete files
+template<class Out>
+bool append_evt_part(Out& out, const string& part, long& next_id,
+                     bool skip_header = false){
+  ifstream fin(part.c_str());
+  if(!fin.good())
+    return false;
+  string line;
+  if(skip_header)
+    getline(fin, line);
+  while(getline(fin, line)){
+    size_t comma = line.find(',');
+    if(comma == string::npos)
+      continue;
+    out << next_id++ << line.substr(comma) << "\n";
+  }
+  return true;
+}
+
+#endif
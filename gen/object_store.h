@@ -0,0 +1,346 @@
+#ifndef __object_store_h
+#define __object_store_h
+
+// Store of the reconstructed objects of every tried event (-store),
+// re-selected offline by the reselect tool without regenerating.
+//
+// Binary file in native byte order, written in blocks of events with
+// one array per quantity (float32 unless noted):
+//
+//   "MJOBJ001"
+//   block:  uint32 nevt, njet, nmuon, nelectron
+//           events:    weight, met_px, met_py, met (< 0 if no MET),
+//                      int32 n_meson, n_glu
+//           offsets:   uint32 jet, muon, electron offsets [nevt+1],
+//                      objects of event i are [offset[i], offset[i+1])
+//           jets:      pt, eta, phi, mass, tau1, tau2, tau3,
+//                      int32 ncharged, nneutral, btag, tautag
+//           muons:     pt, eta, phi, charge
+//           electrons: pt, eta, phi, charge
+//   ...
+//   uint32 0, uint32 ninfo, ninfo x (uint32 length, name, double value)
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <iostream>
+
+using namespace std;
+
+static const char object_store_magic[] = "MJOBJ001";
+
+struct StoreJets {
+  vector<float> pt, eta, phi, mass, tau1, tau2, tau3;
+  vector<int32_t> ncharged, nneutral, btag, tautag;
+
+  size_t size() const {return pt.size();}
+
+  template<class Op> bool columns(Op& op, size_t n){
+    return op(pt, n) && op(eta, n) && op(phi, n) && op(mass, n) &&
+      op(tau1, n) && op(tau2, n) && op(tau3, n) &&
+      op(ncharged, n) && op(nneutral, n) && op(btag, n) && op(tautag, n);
+  }
+};
+
+struct StoreLeptons {
+  vector<float> pt, eta, phi, charge;
+
+  size_t size() const {return pt.size();}
+
+  template<class Op> bool columns(Op& op, size_t n){
+    return op(pt, n) && op(eta, n) && op(phi, n) && op(charge, n);
+  }
+};
+
+class StoreBlock {
+
+public:
+
+  // one entry per event
+  vector<float> weight, met_px, met_py, met;
+  vector<int32_t> n_meson, n_glu;
+
+  // one entry per event, plus one
+  vector<uint32_t> jet_offset, muon_offset, electron_offset;
+
+  StoreJets jets;
+  StoreLeptons muons, electrons;
+
+  StoreBlock(){ clear(); }
+
+  size_t size() const {return weight.size();}
+
+  // Empty the block, keeping the memory
+  void clear(){
+    Clear op;
+    columns(op, 0, 0, 0, 0);
+    jet_offset.assign(1, 0);
+    muon_offset.assign(1, 0);
+    electron_offset.assign(1, 0);
+  }
+
+  // Objects are added first, then end_event closes the event
+  void add_jet(float pt, float eta, float phi, float mass, const float* tau,
+               int ncharged, int nneutral, int btag, int tautag){
+    jets.pt.push_back(pt);
+    jets.eta.push_back(eta);
+    jets.phi.push_back(phi);
+    jets.mass.push_back(mass);
+    jets.tau1.push_back(tau[0]);
+    jets.tau2.push_back(tau[1]);
+    jets.tau3.push_back(tau[2]);
+    jets.ncharged.push_back(ncharged);
+    jets.nneutral.push_back(nneutral);
+    jets.btag.push_back(btag);
+    jets.tautag.push_back(tautag);
+  }
+
+  static void add_lepton(StoreLeptons& leptons, float pt, float eta,
+                         float phi, float charge){
+    leptons.pt.push_back(pt);
+    leptons.eta.push_back(eta);
+    leptons.phi.push_back(phi);
+    leptons.charge.push_back(charge);
+  }
+
+  void end_event(float w, float mpx, float mpy, float m, int nmeson, int nglu){
+    weight.push_back(w);
+    met_px.push_back(mpx);
+    met_py.push_back(mpy);
+    met.push_back(m);
+    n_meson.push_back(nmeson);
+    n_glu.push_back(nglu);
+    jet_offset.push_back(jets.size());
+    muon_offset.push_back(muons.size());
+    electron_offset.push_back(electrons.size());
+  }
+
+  bool write(FILE* f){
+    uint32_t counts[4] = {uint32_t(size()), uint32_t(jets.size()),
+                          uint32_t(muons.size()), uint32_t(electrons.size())};
+    if(fwrite(counts, sizeof(counts), 1, f) != 1)
+      return false;
+    Writer op(f);
+    return columns(op, counts[0], counts[1], counts[2], counts[3]);
+  }
+
+  // Read the next block; false at the end marker or on error
+  bool read(FILE* f, bool& error){
+    uint32_t counts[4];
+    error = true;
+    if(fread(counts, sizeof(uint32_t), 1, f) != 1)
+      return false;
+    if(counts[0] == 0){
+      error = false;
+      return false;
+    }
+    if(fread(counts + 1, sizeof(uint32_t), 3, f) != 3)
+      return false;
+    Reader op(f);
+    if(!columns(op, counts[0], counts[1], counts[2], counts[3]))
+      return false;
+    error = false;
+    return true;
+  }
+
+private:
+
+  template<class Op> bool columns(Op& op, size_t nevt, size_t njet,
+                                  size_t nmuon, size_t nelectron){
+    return op(weight, nevt) && op(met_px, nevt) && op(met_py, nevt) &&
+      op(met, nevt) && op(n_meson, nevt) && op(n_glu, nevt) &&
+      op(jet_offset, nevt + 1) && op(muon_offset, nevt + 1) &&
+      op(electron_offset, nevt + 1) &&
+      jets.columns(op, njet) && muons.columns(op, nmuon) &&
+      electrons.columns(op, nelectron);
+  }
+
+  struct Clear {
+    template<class T> bool operator()(vector<T>& col, size_t){
+      col.clear();
+      return true;
+    }
+  };
+
+  struct Writer {
+    FILE* f;
+    Writer(FILE* f): f(f) {}
+    template<class T> bool operator()(vector<T>& col, size_t n){
+      return n == 0 || fwrite(&col[0], sizeof(T), n, f) == n;
+    }
+  };
+
+  struct Reader {
+    FILE* f;
+    Reader(FILE* f): f(f) {}
+    template<class T> bool operator()(vector<T>& col, size_t n){
+      col.resize(n);
+      return n == 0 || fread(&col[0], sizeof(T), n, f) == n;
+    }
+  };
+};
+
+
+class ObjectStoreWriter {
+
+public:
+
+  // the event being filled, written out every block_events events
+  StoreBlock block;
+  size_t block_events;
+
+  ObjectStoreWriter(): block_events(4096), nevt(0), f(NULL) {}
+  ~ObjectStoreWriter(){ if(f) fclose(f); }
+
+  bool open(const string& fname){
+    f = fopen(fname.c_str(), "wb");
+    if(!f || fwrite(object_store_magic, 8, 1, f) != 1){
+      cerr<<"ERROR: cannot write object store "<<fname<<endl;
+      return false;
+    }
+    filename = fname;
+    return true;
+  }
+
+  bool is_open() const {return f != NULL;}
+  long size() const {return nevt;}
+
+  // Call after each event added to block
+  bool commit(){
+    if(block.size() < block_events)
+      return true;
+    return flush();
+  }
+
+  // Copy a whole block, e.g. from a worker's part
+  bool write_block(StoreBlock& other){
+    if(!flush())
+      return false;
+    nevt += other.size();
+    return other.write(f);
+  }
+
+  // Write the last events and the run information
+  bool close(const vector<pair<string, double> >& info){
+    if(!f)
+      return false;
+    bool ok = flush();
+    uint32_t head[2] = {0, uint32_t(info.size())};
+    ok = ok && fwrite(head, sizeof(head), 1, f) == 1;
+    for(size_t i=0; i<info.size(); ++i){
+      uint32_t len = info[i].first.size();
+      ok = ok && fwrite(&len, sizeof(len), 1, f) == 1 &&
+        fwrite(info[i].first.data(), 1, len, f) == len &&
+        fwrite(&info[i].second, sizeof(double), 1, f) == 1;
+    }
+    ok = (fclose(f) == 0) && ok;
+    f = NULL;
+    if(!ok)
+      cerr<<"ERROR: cannot write object store "<<filename<<endl;
+    return ok;
+  }
+
+private:
+
+  long nevt;
+  FILE* f;
+  string filename;
+
+  bool flush(){
+    if(block.size() == 0)
+      return true;
+    nevt += block.size();
+    bool ok = block.write(f);
+    block.clear();
+    return ok;
+  }
+};
+
+
+class ObjectStoreReader {
+
+public:
+
+  // run information, available once all blocks are read
+  vector<pair<string, double> > info;
+
+  ObjectStoreReader(): f(NULL), error(false) {}
+  ~ObjectStoreReader(){ if(f) fclose(f); }
+
+  bool open(const string& fname){
+    filename = fname;
+    f = fopen(fname.c_str(), "rb");
+    char magic[8];
+    if(!f || fread(magic, 8, 1, f) != 1 || memcmp(magic, object_store_magic, 8) != 0){
+      cerr<<"ERROR: "<<fname<<" is not an object store"<<endl;
+      return false;
+    }
+    // large blocks are read in one go
+    setvbuf(f, NULL, _IOFBF, 1<<20);
+    return true;
+  }
+
+  // Next block of events, false at the end
+  bool next(StoreBlock& block){
+    if(!f)
+      return false;
+    if(block.read(f, error))
+      return true;
+    if(!error)
+      error = !read_info();
+    if(error)
+      cerr<<"ERROR: truncated or corrupt object store "<<filename<<endl;
+    fclose(f);
+    f = NULL;
+    return false;
+  }
+
+  bool failed() const {return error;}
+
+  double get_info(const string& name, double def = 0) const {
+    for(size_t i=0; i<info.size(); ++i)
+      if(info[i].first == name)
+        return info[i].second;
+    return def;
+  }
+
+private:
+
+  FILE* f;
+  bool error;
+  string filename;
+
+  bool read_info(){
+    uint32_t n;
+    if(fread(&n, sizeof(n), 1, f) != 1)
+      return false;
+    for(uint32_t i=0; i<n; ++i){
+      uint32_t len;
+      if(fread(&len, sizeof(len), 1, f) != 1 || len > 4096)
+        return false;
+      string name(len, ' ');
+      double value;
+      if((len > 0 && fread(&name[0], 1, len, f) != len) ||
+         fread(&value, sizeof(value), 1, f) != 1)
+        return false;
+      info.push_back(make_pair(name, value));
+    }
+    return true;
+  }
+};
+
+// Append the blocks of a worker's store
+bool append_store_part(ObjectStoreWriter& store, const string& part){
+  ObjectStoreReader reader;
+  if(!reader.open(part))
+    return false;
+  StoreBlock block;
+  while(reader.next(block))
+    if(!store.write_block(block))
+      return false;
+  return !reader.failed();
+}
+
+#endif
@@ -0,0 +1,188 @@
+// Inspect and clean an output cache of monojet.exe -output_cache
+//
+// Usage: output_cache list dir
+//        output_cache verify [-remove] dir
+//        output_cache gc [-max_days (30)] [-max_gb (0)] [-dry_run] dir
+//
+// list shows every entry with its size, age, last use and command
+// line.  verify rehashes the files of every entry against entry.txt,
+// -remove deletes the entries that do not match.  gc deletes leftovers
+// of interrupted stores, entries with missing or resized files,
+// entries unused for more than -max_days and then, least recently
+// used first, entries until the cache fits in -max_gb (0: no limit).
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <ctime>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "CmdLine/CmdLine.hh"
+#include "output_cache.h"
+
+using namespace std;
+
+struct EntryInfo {
+  string path;
+  CacheEntry entry;
+  bool readable;
+  long size;
+  time_t last_used;
+
+  bool operator<(const EntryInfo& other) const {return last_used < other.last_used;}
+};
+
+// Entries of the cache, and the leftovers of interrupted stores
+void scan_cache(const string& dir, vector<EntryInfo>& entries, vector<string>& leftovers){
+  DIR* d = opendir(dir.c_str());
+  if(!d)
+    return;
+  while(struct dirent* e = readdir(d)){
+    string name = e->d_name;
+    if(name == "." || name == "..")
+      continue;
+    string path = dir + "/" + name;
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+      continue;
+    if(name.compare(0, 5, ".tmp_") == 0){
+      // a store in progress takes seconds, not a day
+      if(time(NULL) - st.st_mtime > 86400)
+        leftovers.push_back(path);
+      continue;
+    }
+
+    EntryInfo info;
+    info.path = path;
+    info.readable = info.entry.read(path + "/entry.txt");
+    info.size = 0;
+    info.last_used = st.st_mtime;
+    for(size_t i=0; i<info.entry.files.size(); ++i)
+      info.size += max(0L, file_size(path + "/" + info.entry.files[i].name));
+    entries.push_back(info);
+  }
+  closedir(d);
+  sort(entries.begin(), entries.end());
+}
+
+// Files present with the recorded sizes, and hashes if rehash
+bool check_entry(const EntryInfo& info, bool rehash){
+  if(!info.readable)
+    return false;
+  for(size_t i=0; i<info.entry.files.size(); ++i){
+    const CacheEntry::File& f = info.entry.files[i];
+    string fname = info.path + "/" + f.name;
+    if(file_size(fname) != f.size || (rehash && file_hash(fname) != f.hash))
+      return false;
+  }
+  return true;
+}
+
+string days(time_t t){
+  ostringstream sout;
+  sout << fixed << setprecision(1) << (time(NULL) - t)/86400. << "d";
+  return sout.str();
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  // command and directory: the arguments that are neither options nor
+  // their values
+  vector<string> words;
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i] == "-remove" || args[i] == "-dry_run")
+      continue;
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    words.push_back(args[i]);
+  }
+
+  if(words.size() != 2 ||
+     (words[0] != "list" && words[0] != "verify" && words[0] != "gc")){
+    cerr<<"Usage: output_cache list (dir)"<<endl
+        <<"       output_cache verify [-remove] (dir)"<<endl
+        <<"       output_cache gc [-max_days (30)] [-max_gb (0)] [-dry_run] (dir)"<<endl;
+    return 1;
+  }
+  string command = words[0], dir = words[1];
+
+  vector<EntryInfo> entries;
+  vector<string> leftovers;
+  scan_cache(dir, entries, leftovers);
+
+  if(command == "list"){
+    long total = 0;
+    for(size_t i=0; i<entries.size(); ++i){
+      const EntryInfo& info = entries[i];
+      total += info.size;
+      cout<<info.entry.digest<<" "<<info.size/1048576.<<" MB, "
+          <<info.entry.files.size()<<" files, created "
+          <<days(info.entry.created)<<" ago, used "<<days(info.last_used)<<" ago"<<endl;
+      string line;
+      for(size_t k=0; k<info.entry.items.size(); ++k)
+        if(info.entry.items[k].compare(0, 4, "arg ") == 0)
+          line += " " + info.entry.items[k].substr(4);
+      cout<<"  "<<line<<endl;
+    }
+    cout<<"INFO: "<<entries.size()<<" entries, "<<total/1048576.<<" MB"<<endl;
+    return 0;
+  }
+
+  if(command == "verify"){
+    bool remove_bad = cmdline.present("-remove");
+    int nbad = 0;
+    for(size_t i=0; i<entries.size(); ++i){
+      if(check_entry(entries[i], true))
+        continue;
+      ++nbad;
+      cout<<"ERROR: entry "<<entries[i].path<<" does not match its entry.txt"
+          <<(remove_bad ? ", removed" : "")<<endl;
+      if(remove_bad)
+        OutputCache::remove_entry(entries[i].path);
+    }
+    cout<<"INFO: "<<entries.size() - nbad<<" of "<<entries.size()<<" entries verified"<<endl;
+    return nbad == 0 || remove_bad ? 0 : 1;
+  }
+
+  // gc
+  bool dry_run = cmdline.present("-dry_run");
+  double max_days = cmdline.value<double>("-max_days", 30);
+  double max_bytes = cmdline.value<double>("-max_gb", 0)*1073741824.;
+
+  vector<string> doomed = leftovers;
+  long total = 0;
+  vector<EntryInfo> kept;
+  for(size_t i=0; i<entries.size(); ++i){
+    const EntryInfo& info = entries[i];
+    if(!check_entry(info, false) || time(NULL) - info.last_used > max_days*86400)
+      doomed.push_back(info.path);
+    else {
+      kept.push_back(info);
+      total += info.size;
+    }
+  }
+
+  // least recently used first
+  for(size_t i=0; i<kept.size() && max_bytes > 0 && total > max_bytes; ++i){
+    doomed.push_back(kept[i].path);
+    total -= kept[i].size;
+  }
+
+  for(size_t i=0; i<doomed.size(); ++i){
+    cout<<(dry_run ? "INFO: would remove " : "INFO: removing ")<<doomed[i]<<endl;
+    if(!dry_run)
+      OutputCache::remove_entry(doomed[i]);
+  }
+  cout<<"INFO: "<<doomed.size()<<(dry_run ? " to remove, " : " removed, ")
+      <<total/1048576.<<" MB kept"<<endl;
+  return 0;
+}
@@ -0,0 +1,311 @@
+#ifndef __output_cache_h
+#define __output_cache_h
+
+// Content-addressed cache of complete run outputs (-output_cache dir)
+//
+// The digest of a run covers everything its outputs depend on: the
+// monojet.exe binary, the command line (output names and bookkeeping
+// options excluded, options sorted), the seed, the contents of the
+// detector cards, histogram configuration and -rndm_state file, and
+// the LHE input by name, size and modification time.  A run whose
+// digest has an entry gets its outputs hard-linked (or copied) from the
+// cache and does not generate anything; a complete run stores copies
+// of its outputs as a new entry
+//
+//   <dir>/<digest>/entry.txt     digest, creation time, what went into
+//                                the digest, name, size and hash of
+//                                every file
+//   <dir>/<digest>/out.meta      outputs, with <output> replaced by out
+//   <dir>/<digest>/out_CMS.evt   ...
+//
+// Entries are written under a temporary name and renamed into place,
+// so concurrent jobs sharing the cache never see half an entry.  Cached
+// files are read-only; outputs restored from them are hard links and
+// read-only as well, and monojet.exe and the shard merge unlink their
+// outputs before writing them, so that nothing writes through a hard
+// link into the cache.  The outputs of a run are never changed by
+// storing them.  The modification time of an entry is its last use, for
+// output_cache gc.  Runs that are not reproducible, with an LHE stream
+// or -seed -1, bypass the cache.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "shard_merge.h"
+
+using namespace std;
+
+// One entry, as described by its entry.txt
+struct CacheEntry {
+  string digest;
+  long created;
+  vector<string> items;      // what went into the digest
+  struct File {
+    string name;
+    long size;
+    string hash;
+  };
+  vector<File> files;
+
+  bool read(const string& fname){
+    ifstream fin(fname.c_str());
+    string line, key;
+    created = 0;
+    while(getline(fin, line)){
+      istringstream sin(line);
+      sin >> key;
+      if(key == "digest")
+        sin >> digest;
+      else if(key == "created")
+        sin >> created;
+      else if(key == "item")
+        items.push_back(line.substr(5));
+      else if(key == "file"){
+        File f;
+        if(sin >> f.name >> f.size >> f.hash)
+          files.push_back(f);
+      }
+    }
+    return digest != "" && !files.empty();
+  }
+
+  bool write(const string& fname) const {
+    ofstream fout(fname.c_str());
+    fout << "# output cache entry\n";
+    fout << "digest " << digest << "\n";
+    fout << "created " << created << "\n";
+    for(size_t i=0; i<items.size(); ++i)
+      fout << "item " << items[i] << "\n";
+    for(size_t i=0; i<files.size(); ++i)
+      fout << "file " << files[i].name << " " << files[i].size << " "
+           << files[i].hash << "\n";
+    return fout.good();
+  }
+};
+
+// Size of a file, -1 if it does not exist
+long file_size(const string& fname){
+  struct stat st;
+  return stat(fname.c_str(), &st) == 0 ? long(st.st_size) : -1;
+}
+
+string file_hash(const string& fname){
+  Hasher h;
+  return h.add_file(fname) ? h.hex() : "";
+}
+
+// Copy src to a new file dst
+bool copy_file(const string& src, const string& dst){
+  remove(dst.c_str());
+  ifstream fin(src.c_str(), ios::binary);
+  ofstream fout(dst.c_str(), ios::binary);
+  fout << fin.rdbuf();
+  return fin.good() && fout.good();
+}
+
+// Hard link src to dst, or copy it across file systems
+bool link_or_copy(const string& src, const string& dst){
+  remove(dst.c_str());
+  if(link(src.c_str(), dst.c_str()) == 0)
+    return true;
+  return copy_file(src, dst);
+}
+
+// Mark an entry as used now
+void touch_entry(const string& path){
+  utime(path.c_str(), NULL);
+}
+
+class OutputCache {
+
+public:
+
+  string dir;
+  string digest;
+  bool enabled;
+
+  OutputCache(): enabled(false) {}
+
+  // Options that only name outputs or do bookkeeping
+  static bool ignored_option(const string& opt){
+    const char* skip[] = {"-o", "-output_cache", "-cost_db", "-init_cache",
+                          "-lhe_index", "-v", "-prune_dry_run",
+                          "-stream", "-stream_slots", "-stream_block",
+                          "-metrics", "-metrics_every"};
+    for(size_t i=0; i<sizeof(skip)/sizeof(skip[0]); ++i)
+      if(opt == skip[i])
+        return true;
+    return false;
+  }
+
+  void add(const string& what, const string& value){
+    hasher.add(what);
+    hasher.add(value);
+    entry.items.push_back(what + " " + value);
+  }
+
+  // Command line as sorted (option, value) pairs
+  void add_arguments(const vector<string>& args){
+    vector<string> pairs;
+    for(size_t i=1; i<args.size(); ++i){
+      string opt = args[i], value;
+      if(i + 1 < args.size() && !is_option(args[i + 1]))
+        value = args[++i];
+      if(!ignored_option(opt))
+        pairs.push_back(value == "" ? opt : opt + " " + value);
+    }
+    sort(pairs.begin(), pairs.end());
+    for(size_t i=0; i<pairs.size(); ++i)
+      add("arg", pairs[i]);
+  }
+
+  // Content of a file, false if it cannot be read
+  bool add_file(const string& what, const string& fname){
+    string hash = file_hash(fname);
+    if(hash == ""){
+      cerr<<"ERROR: cannot read "<<fname<<" for the output cache"<<endl;
+      return false;
+    }
+    add(what, fname + " " + hash);
+    return true;
+  }
+
+  // Large inputs, by name, size and modification time
+  void add_file_stamp(const string& what, const string& fname){
+    struct stat st;
+    ostringstream sout;
+    sout << fname;
+    if(stat(fname.c_str(), &st) == 0)
+      sout << " " << st.st_size << " " << st.st_mtime;
+    add(what, sout.str());
+  }
+
+  void open(const string& cache_dir){
+    dir = cache_dir;
+    enabled = true;
+    mkdir(dir.c_str(), 0755);
+    digest = hasher.hex();
+  }
+
+  string path() const {return dir + "/" + digest;}
+
+  // Restore the outputs of an existing entry; files are (name in the
+  // cache, output path) pairs, and the entry must have exactly those
+  // that exist in it, with complete .meta files
+  bool restore(const vector<pair<string, string> >& files){
+    CacheEntry cached;
+    if(!cached.read(path() + "/entry.txt"))
+      return false;
+
+    for(size_t i=0; i<cached.files.size(); ++i){
+      const CacheEntry::File& f = cached.files[i];
+      string target = find_target(files, f.name);
+      string src = path() + "/" + f.name;
+      if(target == "" || file_size(src) != f.size){
+        cout<<"WARNING: output cache entry "<<digest<<" does not match, ignored"<<endl;
+        return false;
+      }
+      MetaTable meta;
+      if(f.name.size() > 5 && f.name.substr(f.name.size() - 5) == ".meta" &&
+         (!meta.read(src) || (meta.find("status") >= 0 &&
+                              meta.values[meta.find("status")] != "complete")))
+        return false;
+    }
+
+    for(size_t i=0; i<cached.files.size(); ++i){
+      const CacheEntry::File& f = cached.files[i];
+      if(!link_or_copy(path() + "/" + f.name, find_target(files, f.name))){
+        cerr<<"ERROR: cannot restore "<<f.name<<" from the output cache"<<endl;
+        return false;
+      }
+    }
+    touch_entry(path());
+    cout<<"INFO: output cache hit, "<<cached.files.size()<<" files from "
+        <<path()<<endl;
+    return true;
+  }
+
+  // Store the outputs that exist as a new entry
+  bool store(const vector<pair<string, string> >& files){
+    string tmp = dir + "/.tmp_" + digest + "_" + to_string(getpid());
+    if(mkdir(tmp.c_str(), 0755) != 0){
+      cerr<<"ERROR: cannot create "<<tmp<<endl;
+      return false;
+    }
+
+    entry.digest = digest;
+    entry.created = time(NULL);
+    entry.files.clear();
+    for(size_t i=0; i<files.size(); ++i){
+      long size = file_size(files[i].second);
+      if(size < 0)
+        continue;
+      string cached = tmp + "/" + files[i].first;
+      // a copy: a link would share the permissions below with the output
+      if(!copy_file(files[i].second, cached)){
+        cerr<<"ERROR: cannot store "<<files[i].second<<" in the output cache"<<endl;
+        remove_entry(tmp);
+        return false;
+      }
+      chmod(cached.c_str(), 0444);
+      CacheEntry::File f = {files[i].first, size, file_hash(cached)};
+      entry.files.push_back(f);
+    }
+
+    // another job may have stored the same run meanwhile
+    if(!entry.write(tmp + "/entry.txt") || rename(tmp.c_str(), path().c_str()) != 0){
+      remove_entry(tmp);
+      return false;
+    }
+    cout<<"INFO: stored "<<entry.files.size()<<" files in the output cache, "
+        <<path()<<endl;
+    return true;
+  }
+
+  // Remove an entry directory and its files
+  static bool remove_entry(const string& path){
+    DIR* d = opendir(path.c_str());
+    if(!d)
+      return false;
+    while(struct dirent* e = readdir(d)){
+      string name = e->d_name;
+      if(name != "." && name != "..")
+        remove((path + "/" + name).c_str());
+    }
+    closedir(d);
+    return rmdir(path.c_str()) == 0;
+  }
+
+private:
+
+  Hasher hasher;
+  CacheEntry entry;
+
+  // Options start with '-', negative numbers are values
+  static bool is_option(const string& arg){
+    return arg.size() > 1 && arg[0] == '-' && !isdigit(arg[1]) && arg[1] != '.';
+  }
+
+  static string find_target(const vector<pair<string, string> >& files,
+                            const string& name){
+    for(size_t i=0; i<files.size(); ++i)
+      if(files[i].first == name)
+        return files[i].second;
+    return "";
+  }
+};
+
+#endif
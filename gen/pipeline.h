@@ -0,0 +1,121 @@
+#ifndef __pipeline_h
+#define __pipeline_h
+
+// Staged event processing (-pipeline)
+//
+//   generator 0..K-1  --GenRecord-->  detector  --RecoSet-->  selection
+//
+// Each generator runs in its own thread with its own Pythia instance.
+// The detector stage runs on the calling thread, since Delphes and
+// ROOT are not thread safe, and takes the generators' records in
+// strict round-robin order so that the output only depends on the
+// seeds, not on the thread timing.  The selection (and output) runs
+// in one more thread.  Stages are connected by bounded SPSC queues, so
+// a slow stage holds back the ones before it without extra memory.
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "spsc_queue.h"
+#include "event_record.h"
+
+using namespace std;
+
+// produce: fill the next record of generator igen, false once it is done
+// detect: run the detector simulations on a generator record
+// consume: select and write an event, false to stop the run
+void run_pipeline(int ngen,
+                  function<bool(int, GenRecord&)> produce,
+                  function<void(const GenRecord&, RecoSet&)> detect,
+                  function<bool(const RecoSet&)> consume,
+                  size_t capacity = 64){
+
+  atomic<bool> stop(false);
+
+  vector<SPSCQueue<GenRecord>*> gen_queues;
+  for(int g=0; g<ngen; ++g)
+    gen_queues.push_back(new SPSCQueue<GenRecord>(capacity));
+  SPSCQueue<RecoSet> reco_queue(capacity);
+
+  // Generators, each ending with a record marked last
+  vector<thread> generators;
+  for(int g=0; g<ngen; ++g)
+    generators.push_back(thread([&, g](){
+      SPSCQueue<GenRecord>& queue = *gen_queues[g];
+      while(true){
+        GenRecord* rec = queue.wait_write_slot(stop);
+        if(!rec)
+          return;
+        rec->last = !produce(g, *rec);
+        queue.commit();
+        if(rec->last)
+          return;
+      }
+    }));
+
+  // Selection
+  thread selection([&](){
+    while(true){
+      RecoSet* reco = reco_queue.wait_read_slot(stop);
+      if(!reco)
+        return;
+      bool more = !reco->last && consume(*reco);
+      reco_queue.release();
+      if(!more){
+        stop = true;
+        return;
+      }
+    }
+  });
+
+  // Detector, taking one record of each active generator in turn
+  vector<int> active;
+  for(int g=0; g<ngen; ++g)
+    active.push_back(g);
+
+  size_t next = 0;
+  while(!active.empty() && !stop){
+    next %= active.size();
+    SPSCQueue<GenRecord>& queue = *gen_queues[active[next]];
+
+    GenRecord* rec = queue.wait_read_slot(stop);
+    if(!rec)
+      break;
+
+    if(rec->last){
+      queue.release();
+      active.erase(active.begin() + next);
+      continue;
+    }
+
+    RecoSet* reco = reco_queue.wait_write_slot(stop);
+    if(!reco)
+      break;
+    detect(*rec, *reco);
+    reco->last = false;
+    reco_queue.commit();
+    queue.release();
+    ++next;
+  }
+
+  // all generators are done: let the selection drain the queue
+  if(active.empty()){
+    RecoSet* reco = reco_queue.wait_write_slot(stop);
+    if(reco){
+      reco->last = true;
+      reco_queue.commit();
+    }
+  }
+
+  selection.join();
+  stop = true;
+  for(int g=0; g<ngen; ++g)
+    generators[g].join();
+
+  for(int g=0; g<ngen; ++g)
+    delete gen_queues[g];
+}
+
+#endif
@@ -0,0 +1,383 @@
+// Python bindings of the monojet generation pipeline
+//
+//   import pymonojet
+//   gen = pymonojet.Generator("-m tchannel -mphi 1500 -ptmin 200 -seed 3")
+//   cols = gen.run(10000)             # {"evt": array, "MEt": array, ..., "weight": array}
+//   for batch in gen.batches(10**6, 10000):
+//       h.fill(batch["MEt"], weight=batch["weight"])
+//   gen.sigma_gen, gen.n_tried, gen.n_pass
+//
+// A Generator takes the options of monojet.exe (as one string or a
+// list) and runs the same generation, Delphes and selection in this
+// process, without writing files.  Each call to run(n) goes on with the
+// next n accepted events (n tried ones for -m lhe, or up to the end of
+// the LHE file) and returns the columns of the .evt file plus weight as
+// numpy arrays that own the C++ buffers they were filled in, so nothing
+// is copied.  With several -detector cards the result is a dict of
+// such dicts, one per detector tag.  The GIL is released while events
+// are generated; Ctrl-C stops at the next event and drops the events
+// of that call, leaving n_tried, n_pass and the evt numbering as they
+// were before it.
+//
+// Build with the flags of monojet.exe, as a Python extension:
+//
+//   c++ -O2 -shared -fPIC -std=c++14 $(python3 -m pybind11 --includes)
+//     pymonojet.cc tchannel_hidden.cc CmdLine/CmdLine.cc
+//     (Pythia, Delphes, FastJet and ROOT flags and libraries)
+//     -o pymonojet$(python3-config --extension-suffix)
+//
+// Delphes registers its modules by name, so a process holds at most one
+// Generator per detector card at a time.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <climits>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+// ROOT
+#include "TROOT.h"
+#include "TRandom.h"
+#include "TApplication.h"
+
+#include "Pythia8/Pythia.h"
+
+#include "CmdLine/CmdLine.hh"
+#include "generator_setup.h"
+#include "pythia_functions.h"
+#include "lhe_reader.h"
+#include "seeds.h"
+#include "selection.h"
+#include "recluster.h"
+#include "event_record.h"
+#include "detectors.h"
+
+namespace py = pybind11;
+using namespace std;
+
+// Columns of the accepted events of one detector
+typedef vector<vector<double> > Columns;
+
+// Owner of the detectors of a Generator, releasing them even when its
+// constructor throws: Delphes keeps the names of its modules
+// registered until they are deleted
+struct DetectorOwner {
+  vector<Detector*>& detectors;
+  bool initialized;     // InitTask done, FinishTask due
+
+  DetectorOwner(vector<Detector*>& detectors): detectors(detectors), initialized(false) {}
+
+  ~DetectorOwner(){
+    for(size_t d=0; d<detectors.size(); ++d){
+      Detector* det = detectors[d];
+      if(initialized && !det->truth())
+        det->delphes->FinishTask();
+      delete det->delphes;
+      delete det->config;
+      delete det;
+    }
+    detectors.clear();
+  }
+};
+
+class Generator {
+
+public:
+
+  Generator(const vector<string>& options): detector_owner(detectors) {
+    vector<string> args(1, "pymonojet");
+    args.insert(args.end(), options.begin(), options.end());
+    CmdLine cmdline(args);
+
+    mode = cmdline.value<string>("-m", "tchannel");
+    m_lhe = mode == "lhe";
+    rehad = cmdline.present("-rehad");
+    n_tried = n_pass = n_over = last_n = 0;
+    end = false;
+
+    long seed = cmdline.value<long>("-seed", 0);
+    string seed_key = cmdline.value<string>("-seed_key", "");
+    if(seed_key != "")
+      seed = derive_seed(seed_key);
+    else if(seed < 0)
+      seed = random_seed();
+
+    vector<string> prune_arrays;
+    if(!cmdline.present("-noprune"))
+      prune_arrays = reco_event_arrays();
+    if(!setup_detectors(cmdline.value<string>("-detector", "CMS"),
+                        cmdline.value<string>("-o", "pymonojet"), prune_arrays, detectors))
+      throw runtime_error("cannot set up the detectors");
+
+    any_truth = false;
+    for(size_t d=0; d<detectors.size(); ++d)
+      if(detectors[d]->truth()){
+        detectors[d]->truth_jet_def =
+          JetDefinition(antikt_algorithm, cmdline.value<double>("-truth_R", 0.5));
+        any_truth = true;
+      }
+
+    if(m_lhe){
+      string input = cmdline.value<string>("-i", "");
+      bool opened = LHEInput::is_stream(input) ? lhe_input.open_stream(input)
+        : lhe_input.open(input, cmdline.value<string>("-lhe_index", ""));
+      if(!opened)
+        throw runtime_error("cannot read LHE input " + input);
+      if(!LHEInput::is_stream(input))
+        lhe_input.select(cmdline.value<long>("-lhe_first", 0), -1);
+    }
+
+    budget.max_sec = cmdline.value<double>("-max_evt_sec", 0);
+    budget.max_particles = cmdline.value<long>("-max_evt_particles", 0);
+    budget.base = cmdline.value<string>("-o", "pymonojet");
+
+    if(!setup_pythia(pythia, cmdline, mode, &lhe_input, seed,
+                     budget.enabled() ? &budget : NULL) || !pythia.init())
+      throw runtime_error("cannot initialize Pythia");
+    state = GenState(rehad, 10, budget.enabled() ? &budget : NULL);
+
+    read_cuts(cmdline, cuts);
+    if(cmdline.present("-recluster")){
+      if(!reclusterer.configure(cmdline.value<string>("-recluster")))
+        throw runtime_error("bad -recluster");
+      row.add_columns(reclusterer.column_names());
+    }
+    names = row.column_names();
+    names.push_back("weight");
+
+    gROOT->SetBatch();
+    if(!gApplication){
+      static int appargc = 1;
+      static char appName[] = "Delphes";
+      static char* appargv[] = {appName};
+      new TApplication(appName, &appargc, appargv);
+    }
+    gRandom->SetSeed(derive_seed(seed, "delphes", 0));
+    for(size_t d=0; d<detectors.size(); ++d)
+      if(!detectors[d]->truth())
+        detectors[d]->delphes->InitTask();
+    detector_owner.initialized = true;
+  }
+
+  // Next n events, as numpy columns
+  py::object run(long n){
+    vector<Columns> columns(detectors.size(), Columns(names.size()));
+    bool interrupted;
+    {
+      py::gil_scoped_release release;
+      interrupted = !generate(n, columns);
+    }
+    if(interrupted)
+      throw py::error_already_set();
+
+    if(detectors.size() == 1)
+      return to_numpy(columns[0]);
+    py::dict result;
+    for(size_t d=0; d<detectors.size(); ++d)
+      result[detectors[d]->tag.c_str()] = to_numpy(columns[d]);
+    return result;
+  }
+
+  bool at_end() const {return end;}
+
+  // Generator cross section (pb), corrected for events over budget
+  double sigma_gen() const {
+    return pythia.info.sigmaGen()*state.cxn_scale(pythia.info)*1e9;
+  }
+  double sigma_err() const {
+    return pythia.info.sigmaErr()*state.cxn_scale(pythia.info)*1e9;
+  }
+
+  long n_tried, n_pass, n_over;
+  long last_n;          // events counted towards n by the last run
+  vector<string> names;
+
+  vector<string> detector_tags() const {
+    vector<string> tags;
+    for(size_t d=0; d<detectors.size(); ++d)
+      tags.push_back(detectors[d]->tag);
+    return tags;
+  }
+
+private:
+
+  string mode;
+  bool m_lhe, rehad, any_truth, end;
+
+  LHEInput lhe_input;
+  Pythia pythia;
+  EventBudget budget;
+  GenState state;
+  vector<Detector*> detectors;
+  DetectorOwner detector_owner;
+
+  SelectionCuts cuts;
+  Reclusterer reclusterer;
+  EvtRow row;
+
+  // scratch space, reused every event
+  RecoEvent reco;
+  GenRecord truth_record;
+  vector<PseudoJet> truth_particles, selected_jets;
+
+  Generator(const Generator&);
+
+  // Generate until n events are accepted by the first detector (n
+  // tried in LHE mode); false if interrupted from Python, with the
+  // counters as they were, since the columns are dropped
+  bool generate(long n, vector<Columns>& columns){
+    long accepted = 0, tried = 0;
+    long n_tried_before = n_tried, n_pass_before = n_pass, n_over_before = n_over;
+    vector<long> det_pass_before;
+    for(size_t d=0; d<detectors.size(); ++d)
+      det_pass_before.push_back(detectors[d]->n_pass);
+
+    while(!end && (m_lhe ? tried : accepted) < n){
+
+      // a Python signal handler, Ctrl-C, stops the run
+      {
+        py::gil_scoped_acquire acquire;
+        if(PyErr_CheckSignals() != 0){
+          n_tried = n_tried_before;
+          n_pass = n_pass_before;
+          n_over = n_over_before;
+          for(size_t d=0; d<detectors.size(); ++d)
+            detectors[d]->n_pass = det_pass_before[d];
+          last_n = 0;
+          return false;
+        }
+      }
+
+      GenStatus status = generate_event(pythia, state);
+      if(status == GEN_END || (status == GEN_ABORT && !rehad))
+        end = true;
+      if(status != GEN_OK)
+        continue;
+
+      n_over += state.n_over;
+      n_tried += state.n_over + 1;
+      ++tried;
+
+      int n_meson = get_nmeson(pythia.event);
+      int n_glu = get_glu(pythia.event);
+      if(any_truth)
+        fill_gen_record(pythia.event, truth_record);
+
+      for(size_t d=0; d<detectors.size(); ++d){
+        Detector& det = *detectors[d];
+        if(det.truth())
+          fill_truth_event(truth_record, det.truth_jet_def, det.truth_jet_ptmin,
+                           truth_particles, reco);
+        else {
+          det.delphes->Clear();
+          Pythia_to_Delphes(det.factory, det.stable, pythia.event);
+          det.delphes->ProcessTask();
+          fill_reco_event(det.delphes, reco);
+        }
+        reco.weight = pythia.info.weight();
+        reco.n_meson = n_meson;
+        reco.n_glu = n_glu;
+
+        if(!select_event(reco, cuts, row, selected_jets))
+          continue;
+
+        row.v[EvtRow::evt] = det.n_pass;
+        row.v[EvtRow::n_meson] = n_meson;
+        row.v[EvtRow::n_glu] = n_glu;
+        if(reclusterer.size() > 0){
+          PseudoJet MEt(-reco.met_px, -reco.met_py, 0, reco.met);
+          reclusterer.fill(selected_jets, MEt, &row.v[EvtRow::ncol]);
+        }
+
+        Columns& cols = columns[d];
+        for(size_t c=0; c<row.v.size(); ++c)
+          cols[c].push_back(row.v[c]);
+        cols.back().push_back(row.weight);
+
+        ++det.n_pass;
+        if(d == 0){
+          ++accepted;
+          ++n_pass;
+        }
+      }
+    }
+    last_n = m_lhe ? tried : accepted;
+    return true;
+  }
+
+  // numpy arrays viewing the column buffers, which they then own
+  py::dict to_numpy(Columns& cols) const {
+    py::dict result;
+    for(size_t c=0; c<cols.size(); ++c){
+      vector<double>* buffer = new vector<double>();
+      buffer->swap(cols[c]);
+      py::capsule owner(buffer, [](void* p){delete (vector<double>*) p;});
+      result[names[c].c_str()] =
+        py::array_t<double>(buffer->size(), buffer->data(), owner);
+    }
+    return result;
+  }
+};
+
+// Generator.batches(n, size): the next n events, size at a time
+class BatchIterator {
+
+public:
+
+  BatchIterator(Generator& gen, long n, long size):
+    gen(gen), remaining(n), size(size) {}
+
+  py::object next(){
+    if(remaining <= 0 || gen.at_end())
+      throw py::stop_iteration();
+    py::object batch = gen.run(min(size, remaining));
+    remaining -= gen.last_n;
+    return batch;
+  }
+
+private:
+
+  Generator& gen;
+  long remaining, size;
+};
+
+// Options given as one string, split at whitespace
+Generator* make_generator(const string& options){
+  istringstream sin(options);
+  vector<string> args;
+  string arg;
+  while(sin >> arg)
+    args.push_back(arg);
+  return new Generator(args);
+}
+
+PYBIND11_MODULE(pymonojet, m){
+  m.doc() = "Generation, detector simulation and monojet selection of monojet.exe, "
+    "returning the .evt columns as numpy arrays";
+
+  py::class_<Generator>(m, "Generator")
+    .def(py::init<const vector<string>&>(), py::arg("options"))
+    .def(py::init(&make_generator), py::arg("options"))
+    .def("run", &Generator::run, py::arg("n"),
+         "Next n accepted events (tried ones with -m lhe), as numpy columns")
+    .def("batches", [](Generator& gen, long n, long size){
+        return new BatchIterator(gen, n, size);
+      }, py::arg("n"), py::arg("size") = 10000, py::keep_alive<0, 1>(),
+      "Iterator over the next n events, size at a time")
+    .def_property_readonly("at_end", &Generator::at_end)
+    .def_property_readonly("sigma_gen", &Generator::sigma_gen)
+    .def_property_readonly("sigma_err", &Generator::sigma_err)
+    .def_readonly("n_tried", &Generator::n_tried)
+    .def_readonly("n_pass", &Generator::n_pass)
+    .def_readonly("n_over_budget", &Generator::n_over)
+    .def_readonly("columns", &Generator::names)
+    .def_property_readonly("detectors", &Generator::detector_tags);
+
+  py::class_<BatchIterator>(m, "BatchIterator")
+    .def("__iter__", [](BatchIterator& it) -> BatchIterator& {return it;})
+    .def("__next__", &BatchIterator::next);
+}
@@ -3,6 +3,7 @@
 
 #include "fastjet/ClusterSequence.hh"
 #include "tchannel_hidden.hh"
+#include "event_watchdog.h"
 
 // Delphes library
 #include "modules/Delphes.h"
@@ -301,6 +302,114 @@ void Pythia_to_Delphes(DelphesFactory* factory,
   }
 }
 
+// Result of generate_event
+enum GenStatus {GEN_OK, GEN_END, GEN_ABORT};
+
+// Per-generator state kept between events
+struct GenState {
+  bool rehad;
+  int iAbort, nAbort;
+  long n_generated;
+  Pythia8::Event saved_event;
+  EventBudget* budget;   // per-event budget, NULL without
+  int n_over;            // events over budget before the last one
+
+  GenState(bool rehad = false, int nAbort = 10, EventBudget* budget = NULL):
+    rehad(rehad), iAbort(0), nAbort(nAbort), n_generated(0), budget(budget),
+    n_over(0) {}
+
+  // Correction of Pythia's cross section for the vetoed events
+  double cxn_scale(const Pythia8::Info& info) const {
+    return budget ? budget->cxn_scale(info) : 1;
+  }
+};
+
+// Generate the next event into pythia.event.  With rehadronization
+// a new parton-level event is only made every 5 events, the others
+// rehadronize the saved one.  Events over the budget are skipped and
+// counted in state.n_over.
+GenStatus generate_event(Pythia& pythia, GenState& state){
+
+  bool pythia_status;
+  long n_over = state.budget ? state.budget->n_over() : 0;
+
+  if(state.rehad){
+    GenStatus status = GEN_OK;
+
+    // Renew an event
+    if(state.n_generated % 5 == 0){
+      if(state.budget)
+        state.budget->begin(pythia);
+      while (!(pythia_status=pythia.next())) {
+
+        if(pythia.info.atEndOfFile()){
+          cout <<"Pythia reached end of file"<<endl;
+          status = GEN_END;
+          break;
+        }
+
+        if (++state.iAbort < state.nAbort) continue;
+
+        cerr << "ERROR: Event generation aborted prematurely, owing to error!" << endl;
+        status = GEN_ABORT;
+        break;
+      }
+
+      state.saved_event = pythia.event;
+    }
+
+    else {
+      pythia.event = state.saved_event;
+      if(state.budget)
+        state.budget->start(true);
+    }
+
+    // Run hadronization
+    pythia.forceHadronLevel();
+
+    if(status != GEN_OK)
+      return status;
+
+    // over budget: a new parton-level event next time
+    if(state.budget && state.budget->drop(pythia.event)){
+      state.n_generated += 5 - state.n_generated % 5;
+      status = generate_event(pythia, state);
+      if(status == GEN_OK)
+        state.n_over = state.budget->n_over() - n_over;
+      return status;
+    }
+  }
+  else {
+    while (true) {
+      if(state.budget)
+        state.budget->begin(pythia);
+
+      if((pythia_status=pythia.next())){
+        if(state.budget && state.budget->drop(pythia.event))
+          continue;
+        break;
+      }
+
+      cout<<"Pythia failed, status "<<pythia_status<<endl;
+
+      if(pythia.info.atEndOfFile()){
+        cout <<"Pythia reached end of file"<<endl;
+        return GEN_END;
+      }
+
+      if (++state.iAbort < state.nAbort) continue;
+      cerr<<"ERROR: Event generation aborted due to error!"
+          <<endl;
+      return GEN_ABORT;
+    }
+  }
+
+  if(state.budget)
+    state.n_over = state.budget->n_over() - n_over;
+  ++state.n_generated;
+  return GEN_OK;
+}
+
 
 //class to estimate remaining time
 class Timer{
@@ -329,7 +438,12 @@ class Timer{
 
     time_list.push_back(now);
     proc_list.push_back(nproc);
-    
+
+    //the estimate only looks max_interval updates back
+    if(int(time_list.size()) > max_interval){
+      time_list.erase(time_list.begin());
+      proc_list.erase(proc_list.begin());
+    }
   }
 
   friend ostream& operator<< (ostream &out, Timer& mytime);
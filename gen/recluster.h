@@ -0,0 +1,169 @@
+#ifndef __recluster_h
+#define __recluster_h
+
+// Reclustering of the selected jets into several large-R jet
+// collections in one pass (-recluster alg:R1,R2,...)
+//
+// With Cambridge/Aachen all beam distances are equal, so the pairwise
+// merging order does not depend on R: a single ClusterSequence at the
+// largest R gives the jets of every smaller R' as its exclusive jets
+// at dcut = (R'/Rmax)^2.  kt and anti-kt need one clustering per R,
+// which reuse the same input jets and jet definitions.
+//
+// Each collection adds the columns
+//   nj_<tag>, pt1_<tag>, eta1_<tag>, m1_<tag>, pt2_<tag>, eta2_<tag>,
+//   m2_<tag>, mjj_<tag>, dphi_<tag>
+// with <tag> = R1p1 for R = 1.1.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "fastjet/ClusterSequence.hh"
+
+#include "kinematics.h"
+
+using namespace std;
+using namespace fastjet;
+
+class Reclusterer {
+
+public:
+
+  static const int ncol_per_R = 9;
+
+  Reclusterer(): algorithm(cambridge_algorithm), r_max(0) {}
+
+  // "ca:0.8,1.1,1.5", "kt:..." or "antikt:..."
+  bool configure(const string& spec){
+    size_t colon = spec.find(':');
+    string alg = spec.substr(0, colon);
+    if(alg == "ca" || alg == "cambridge")
+      algorithm = cambridge_algorithm;
+    else if(alg == "kt")
+      algorithm = kt_algorithm;
+    else if(alg == "antikt")
+      algorithm = antikt_algorithm;
+    else {
+      cerr<<"ERROR: unknown reclustering algorithm "<<alg<<endl;
+      return false;
+    }
+
+    radii.clear();
+    if(colon != string::npos){
+      stringstream sin(spec.substr(colon + 1));
+      string item;
+      while(getline(sin, item, ','))
+        radii.push_back(atof(item.c_str()));
+    }
+    if(radii.empty()){
+      cerr<<"ERROR: no radius given in -recluster "<<spec<<endl;
+      return false;
+    }
+
+    defs.clear();
+    r_max = 0;
+    for(size_t i=0; i<radii.size(); ++i){
+      if(radii[i] <= 0){
+        cerr<<"ERROR: bad reclustering radius in "<<spec<<endl;
+        return false;
+      }
+      defs.push_back(JetDefinition(algorithm, radii[i]));
+      r_max = max(r_max, radii[i]);
+    }
+    collections.resize(radii.size());
+
+    cout<<"INFO: reclustering into "<<alg<<" jets, R =";
+    for(size_t i=0; i<radii.size(); ++i)
+      cout<<" "<<radii[i];
+    cout<<endl;
+    return true;
+  }
+
+  size_t size() const {return radii.size();}
+
+  vector<string> column_names() const {
+    const char* names[ncol_per_R] = {"nj", "pt1", "eta1", "m1",
+                                     "pt2", "eta2", "m2", "mjj", "dphi"};
+    vector<string> columns;
+    for(size_t i=0; i<radii.size(); ++i)
+      for(int j=0; j<ncol_per_R; ++j)
+        columns.push_back(string(names[j]) + "_" + tag(radii[i]));
+    return columns;
+  }
+
+  // Recluster jets and write ncol_per_R values per radius to out
+  void fill(const vector<PseudoJet>& jets, const PseudoJet& met, double* out){
+
+    if(jets.empty()){
+      for(size_t i=0; i<radii.size(); ++i)
+        collections[i].clear();
+    }
+    else if(algorithm == cambridge_algorithm){
+      ClusterSequence cs(jets, JetDefinition(algorithm, r_max));
+      for(size_t i=0; i<radii.size(); ++i){
+        if(radii[i] == r_max)
+          collections[i] = sorted_by_pt(cs.inclusive_jets());
+        else
+          collections[i] = sorted_by_pt
+            (cs.exclusive_jets(radii[i]*radii[i]/(r_max*r_max)));
+      }
+    }
+    else {
+      for(size_t i=0; i<radii.size(); ++i){
+        ClusterSequence cs(jets, defs[i]);
+        collections[i] = sorted_by_pt(cs.inclusive_jets());
+      }
+    }
+
+    for(size_t i=0; i<radii.size(); ++i)
+      write_columns(collections[i], met, out + i*ncol_per_R);
+  }
+
+private:
+
+  JetAlgorithm algorithm;
+  vector<double> radii;
+  vector<JetDefinition> defs;
+  double r_max;
+
+  // kept between events
+  vector<vector<PseudoJet> > collections;
+
+  static string tag(double R){
+    stringstream sout;
+    sout<<R;
+    string s = sout.str();
+    replace(s.begin(), s.end(), '.', 'p');
+    return "R" + s;
+  }
+
+  static void write_columns(const vector<PseudoJet>& jets, const PseudoJet& met,
+                            double* out){
+    out[0] = jets.size();
+    for(int j=0; j<2; ++j){
+      double* col = out + 1 + 3*j;
+      if(jets.size() > size_t(j)){
+        col[0] = jets[j].pt();
+        col[1] = jets[j].eta();
+        col[2] = jets[j].m();
+      }
+      else {
+        col[0] = -1;
+        col[1] = 999;
+        col[2] = 0;
+      }
+    }
+    out[7] = jets.size() >= 2 ? (jets[0] + jets[1]).m() : 0;
+
+    double dphi = 999;
+    for(size_t j=0; j<4 && j<jets.size(); ++j)
+      dphi = min(dphi, kin_dphi(met.phi(), jets[j].phi()));
+    out[8] = dphi;
+  }
+};
+
+#endif
@@ -0,0 +1,384 @@
+// Re-apply the monojet selection to object stores written by
+// monojet.exe -store, without regenerating
+//
+// Usage: reselect -o out [cuts as for monojet.exe] [-hist config] [-w] [-noevt] [-evt_format g6] run1.objs ...
+//        reselect -o out -scan selections.txt run1.objs ...
+//
+// The first form writes out.evt and out.meta (and out.hist.json) as
+// monojet.exe would have with these cuts.  The second evaluates every
+// selection of the scan file, one per line as
+//
+//   name -ptmin 200 -metmin 300 -dphimin 0.4
+//
+// in a single pass over the events and writes out.scan.csv with the
+// number of passing events and the cross-section of each.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+
+#include "CmdLine/CmdLine.hh"
+#include "selection.h"
+#include "csv_writer.h"
+#include "object_store.h"
+#include "histograms.h"
+#include "cxn_combine.h"
+#include "kinematics.h"
+
+using namespace std;
+
+// Kinematics of all jets of a block, computed once for all selections
+struct BlockKinematics {
+
+  // per event
+  vector<double> met_x, met_y, met_phi;
+
+  // per jet: MET azimuth of its event, dphi to it
+  vector<double> jet_met_phi, dphi;
+
+  // per jet, only needed for the output columns
+  vector<double> px, py, pz, e, y;
+
+  void compute_angles(const StoreBlock& b){
+    size_t nevt = b.size(), njet = b.jets.size();
+
+    // MET points opposite to the stored vector, see select_event()
+    met_x.resize(nevt);
+    met_y.resize(nevt);
+    met_phi.resize(nevt);
+    for(size_t i=0; i<nevt; ++i){
+      met_x[i] = -b.met_px[i];
+      met_y[i] = -b.met_py[i];
+    }
+    kin_phi(nevt, met_x.data(), met_y.data(), met_phi.data());
+
+    jet_met_phi.resize(njet);
+    dphi.resize(njet);
+    for(size_t i=0; i<nevt; ++i)
+      for(uint32_t k=b.jet_offset[i]; k<b.jet_offset[i+1]; ++k)
+        jet_met_phi[k] = met_phi[i];
+    kin_dphi(njet, jet_met_phi.data(), b.jets.phi.data(), dphi.data());
+  }
+
+  void compute_momenta(const StoreBlock& b){
+    size_t njet = b.jets.size();
+    px.resize(njet);
+    py.resize(njet);
+    pz.resize(njet);
+    e.resize(njet);
+    y.resize(njet);
+    kin_cartesian(njet, b.jets.pt.data(), b.jets.eta.data(), b.jets.phi.data(),
+                  b.jets.mass.data(), px.data(), py.data(), pz.data(), e.data());
+    kin_rapidity(njet, e.data(), pz.data(), y.data());
+  }
+};
+
+// Monojet selection on event i of a block, as select_event() does on
+// the reconstructed event; fills row when given (which needs the
+// momenta of kin)
+bool select_stored(const StoreBlock& b, const BlockKinematics& kin, size_t i,
+                   const SelectionCuts& cuts, EvtRow* row){
+
+  float met = b.met[i];
+  if(met < 0)
+    return false;
+  if(met < cuts.met_min || met > cuts.met_max)
+    return false;
+
+  // Lepton veto
+  if(cuts.lepton_veto){
+    for(uint32_t k=b.muon_offset[i]; k<b.muon_offset[i+1]; ++k)
+      if(fabs(b.muons.eta[k]) <= cuts.muon_eta && b.muons.pt[k] >= cuts.muon_pt)
+        return false;
+    for(uint32_t k=b.electron_offset[i]; k<b.electron_offset[i+1]; ++k)
+      if(fabs(b.electrons.eta[k]) <= cuts.electron_eta &&
+         b.electrons.pt[k] >= cuts.electron_pt)
+        return false;
+  }
+
+  // Only the 4 leading selected jets are used beyond counting
+  uint32_t sel[4];
+  int nsel = 0;
+  for(uint32_t k=b.jet_offset[i]; k<b.jet_offset[i+1]; ++k){
+    if(b.jets.pt[k] < cuts.jet_pt || fabs(b.jets.eta[k]) > cuts.jet_eta)
+      continue;
+    if(nsel < 4)
+      sel[nsel] = k;
+    ++nsel;
+  }
+
+  double lead_pt = nsel > 0 ? b.jets.pt[sel[0]] : 0;
+  if(nsel < cuts.njet || lead_pt < cuts.pt_min || nsel > cuts.njet_max)
+    return false;
+
+  double dphi = 999;
+  for(int j=0; j<nsel && j<4; ++j)
+    dphi = dphi < kin.dphi[sel[j]] ? dphi : kin.dphi[sel[j]];
+  if(dphi < cuts.dphi_min)
+    return false;
+
+  if(!row)
+    return true;
+
+  double* v = row->v.data();
+  v[EvtRow::MEt] = met;
+  v[EvtRow::mjj] = 0;
+  v[EvtRow::Mt] = 0;
+  if(nsel >= 2){
+    uint32_t k0 = sel[0], k1 = sel[1];
+    kin_pair_mass(1, &kin.px[k0], &kin.py[k0], &kin.pz[k0], &kin.e[k0],
+                  &kin.px[k1], &kin.py[k1], &kin.pz[k1], &kin.e[k1],
+                  v + EvtRow::mjj);
+    double e_sum = met + kin.e[k0] + kin.e[k1];
+    double pz_sum = kin.pz[k0] + kin.pz[k1];
+    kin_mperp(1, &e_sum, &pz_sum, v + EvtRow::Mt);
+  }
+
+  for(int j=0; j<4; j++){
+    double* col = v + EvtRow::pt1 + 3*j;
+    if(nsel > j){
+      col[0] = b.jets.pt[sel[j]];
+      col[1] = b.jets.eta[sel[j]];
+      col[2] = kin.y[sel[j]];
+    }
+    else{
+      col[0] = -1;
+      col[1] = 999;
+      col[2] = 0;
+    }
+  }
+
+  v[EvtRow::dphi] = dphi;
+  v[EvtRow::nj] = nsel;
+  v[EvtRow::n_meson] = b.n_meson[i];
+  v[EvtRow::n_glu] = b.n_glu[i];
+  row->weight = b.weight[i];
+  return true;
+}
+
+// One selection of a scan
+struct ScanEntry {
+  string name;
+  SelectionCuts cuts;
+  long npass;
+  double sum_weight;
+};
+
+bool read_scan(const string& fname, vector<ScanEntry>& scan){
+  ifstream fin(fname.c_str());
+  if(!fin.good()){
+    cerr<<"ERROR: cannot open "<<fname<<endl;
+    return false;
+  }
+  string line;
+  while(getline(fin, line)){
+    istringstream sin(line);
+    vector<string> args;
+    string word;
+    while(sin >> word)
+      args.push_back(word);
+    if(args.empty() || args[0][0] == '#')
+      continue;
+
+    ScanEntry entry;
+    entry.name = args[0];
+    read_cuts(CmdLine(args), entry.cuts);
+    entry.npass = 0;
+    entry.sum_weight = 0;
+    if(entry.cuts.Zprime){
+      cerr<<"ERROR: "<<entry.name<<": -Zprime reclustering is not available offline"<<endl;
+      return false;
+    }
+    scan.push_back(entry);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  string output = cmdline.value<string>("-o", "reselect");
+  bool weighted = cmdline.present("-w");
+  bool write_evt = !cmdline.present("-noevt");
+
+  // remaining arguments that are neither options nor their values
+  vector<string> inputs;
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i][0] == '-'){
+      if(args[i] != "-w" && args[i] != "-noevt" && args[i] != "-Zprime")
+        ++i;
+      continue;
+    }
+    inputs.push_back(args[i]);
+  }
+
+  if(inputs.empty()){
+    cerr<<"Usage: reselect -o (output) [cuts] [-hist (config)] [-w] [-noevt] [-evt_format (g6)] "
+        <<"[-scan (selections)] file1.objs file2.objs ..."<<endl;
+    return 1;
+  }
+
+  // One selection from the command line, or many from -scan
+  vector<ScanEntry> scan;
+  bool scan_mode = cmdline.present("-scan");
+  if(scan_mode){
+    if(!read_scan(cmdline.value<string>("-scan"), scan))
+      return 1;
+    write_evt = false;
+  }
+  else {
+    ScanEntry entry;
+    entry.name = "cmdline";
+    read_cuts(cmdline, entry.cuts);
+    entry.npass = 0;
+    entry.sum_weight = 0;
+    if(entry.cuts.Zprime){
+      cerr<<"ERROR: -Zprime reclustering is not available offline, exiting..."<<endl;
+      return 1;
+    }
+    scan.push_back(entry);
+  }
+
+  EvtRow row;
+
+  HistogramSet hists;
+  string hist_config = cmdline.value<string>("-hist", "");
+  if(!scan_mode && hist_config != "" &&
+     (!hists.read_config(hist_config) || !hists.bind(row.column_names())))
+    return 1;
+
+  CsvWriter file_evt;
+  if(!file_evt.set_format(cmdline.value<string>("-evt_format", "g6")))
+    return 1;
+  if(write_evt){
+    file_evt.open((output + ".evt").c_str());
+    row.write_header(file_evt, weighted);
+  }
+
+  bool fill_row = write_evt || !hists.empty();
+
+  // events read, and events tried by the runs: those over the
+  // per-event budget were tried but never stored
+  CxnCombiner combined;
+  long nevt = 0, ntried = 0;
+  double sum_weight = 0;
+  StoreBlock block;
+  BlockKinematics kin;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for(size_t f=0; f<inputs.size(); ++f){
+    ObjectStoreReader reader;
+    if(!reader.open(inputs[f]))
+      return 1;
+
+    long file_nevt = 0;
+    while(reader.next(block)){
+      kin.compute_angles(block);
+      if(fill_row)
+        kin.compute_momenta(block);
+
+      for(size_t i=0; i<block.size(); ++i){
+        sum_weight += block.weight[i];
+
+        for(size_t s=0; s<scan.size(); ++s){
+          ScanEntry& entry = scan[s];
+          if(!select_stored(block, kin, i, entry.cuts, fill_row ? &row : NULL))
+            continue;
+
+          if(fill_row){
+            row.v[EvtRow::evt] = entry.npass;
+            if(!hists.empty())
+              hists.fill(row.v.data(), weighted ? row.weight : 1.0);
+            if(write_evt)
+              row.write_csv(file_evt, weighted);
+          }
+
+          ++entry.npass;
+          entry.sum_weight += block.weight[i];
+        }
+      }
+      file_nevt += block.size();
+    }
+    if(reader.failed())
+      return 1;
+
+    long file_ntried = long(reader.get_info("nevt", file_nevt));
+    nevt += file_nevt;
+    ntried += file_ntried;
+    combined.add(reader.get_info("cxn"), reader.get_info("cxn_err"), file_ntried);
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout<<"INFO: "<<nevt<<" events, "<<scan.size()<<" selections in "
+      <<seconds<<" s ("<<(seconds > 0 ? nevt/seconds : 0)<<" events/s)"<<endl;
+
+  double cxn = combined.cxn();
+  double cxn_err = combined.err();
+
+  if(scan_mode){
+    ofstream file_scan((output + ".scan.csv").c_str());
+    file_scan << "name, npass, eff, cxn, cxn_err";
+    if(weighted)
+      file_scan << ", sum_weight";
+    file_scan << endl;
+
+    for(size_t s=0; s<scan.size(); ++s){
+      double eff = ntried > 0 ? scan[s].npass/double(ntried) : 0;
+      file_scan << scan[s].name << ","
+                << scan[s].npass << ","
+                << eff << ","
+                << cxn*eff << ","
+                << cxn_err*eff;
+      if(weighted)
+        file_scan << ", " << scan[s].sum_weight;
+      file_scan << endl;
+    }
+    cout<<"INFO: wrote "<<output<<".scan.csv"<<endl;
+    return 0;
+  }
+
+  // Same .meta as monojet.exe
+  long npass = scan[0].npass;
+  const SelectionCuts& cuts = scan[0].cuts;
+
+  ofstream file_meta((output + ".meta").c_str());
+  file_meta<<"nevt, npass, eff, total, pass, "
+     <<"ptcut, metcut, cxn, cxn_err";
+  if(weighted)
+    file_meta << ", sum_weight";
+  file_meta<<endl;
+
+  file_meta<<ntried<<","<<npass<<","
+     <<npass/double(ntried)<<","
+     <<ntried<<","
+     <<npass<<","
+     <<cuts.pt_min<<","
+     <<cuts.met_min<<","
+     <<cxn<<","
+     <<cxn_err;
+  if(weighted)
+    file_meta << ", "<< sum_weight;
+  file_meta << endl;
+
+  if(!hists.empty()){
+    vector<pair<string, double> > info;
+    info.push_back(make_pair("nevt", double(ntried)));
+    info.push_back(make_pair("npass", double(npass)));
+    info.push_back(make_pair("cxn", cxn));
+    info.push_back(make_pair("cxn_err", cxn_err));
+    if(weighted)
+      info.push_back(make_pair("sum_weight", sum_weight));
+    if(!hists.write_json(output + ".hist.json", info))
+      return 1;
+  }
+
+  cout<<"INFO: "<<npass<<" of "<<ntried<<" events pass"<<endl;
+  return 0;
+}
@@ -0,0 +1,286 @@
+#ifndef __run_metrics_h
+#define __run_metrics_h
+
+// Live metrics of a run (-metrics sink, -metrics_every seconds)
+//
+// Every -metrics_every seconds (10) the run reports, in constant
+// memory, its counts, event rates averaged exponentially over the last
+// few reports, the acceptance with its binomial error, the time per
+// event of each stage (summed over its threads), its memory and the
+// failed generator calls.  On the console this is one INFO line; with
+// -metrics the same goes as one JSON object per line to
+//
+//   file          appended, one write per line, so that many jobs can
+//                 share a file
+//   unix:path     datagrams to a Unix socket, where metrics_top listens;
+//                 lost while nobody listens
+//
+// A last line with the final status ("complete", "interrupted",
+// "aborted") ends the run; before it the status is "running".  Fields:
+//
+//   job, host, pid, worker, time, elapsed, status, n_tried, n_pass,
+//   target, target_kind ("pass" or "tried"), rate_tried, rate_pass
+//   (events/s), eff, eff_err, sigma_pb, sigma_err_pb, eta_sec (-1 if
+//   unknown), sec_per_evt {generation, detector, selection}, rss_mb,
+//   max_rss_mb, gen_errors, n_over_budget
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "json_lite.h"
+#include "cost_db.h"
+
+using namespace std;
+
+enum MetricStage {STAGE_GENERATION, STAGE_DETECTOR, STAGE_SELECTION, STAGE_NSTAGE};
+
+// Resident memory now, in MB (0 if unknown)
+double current_rss_mb(){
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if(!f)
+    return 0;
+  if(fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  fclose(f);
+  return resident*(sysconf(_SC_PAGESIZE)/1048576.);
+}
+
+// h, m, s of a duration
+string duration_text(double sec){
+  long s = lround(sec), m = s/60, h = m/60, d = h/24;
+  ostringstream sout;
+  sout << setfill('0');
+  if(d > 0)
+    sout << d << "d " << setw(2) << h % 24 << "h " << setw(2) << m % 60 << "m";
+  else if(h > 0)
+    sout << h << "h " << setw(2) << m % 60 << "m " << setw(2) << s % 60 << "s";
+  else if(m > 0)
+    sout << m << "m " << setw(2) << s % 60 << "s";
+  else
+    sout << s << "s";
+  return sout.str();
+}
+
+class RunMetrics {
+
+public:
+
+  string job;           // run label, -seed_key or the output name
+  int worker;           // -procs worker, -1 otherwise
+  double interval;      // seconds between reports
+  long target;          // events to reach, 0 if unknown
+  bool target_pass;     // target counts accepted events, or tried ones
+  bool console;         // INFO lines on cout
+
+  RunMetrics(): worker(-1), interval(10), target(0), target_pass(true), console(true),
+    fd(-1), is_socket(false), n_tried(0), n_pass(0), sigma(0), sigma_err(0), n_over(0),
+    rate_tried(-1), rate_pass(-1), last_tried(0), last_pass(0) {
+    for(int s=0; s<STAGE_NSTAGE; ++s)
+      stage_ns[s] = 0;
+  }
+
+  ~RunMetrics(){
+    if(fd >= 0)
+      ::close(fd);
+  }
+
+  // A file to append to, or unix:path
+  bool open(const string& sink){
+    if(sink.compare(0, 5, "unix:") == 0){
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, sink.c_str() + 5, sizeof(addr.sun_path) - 1);
+      fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+      socket_addr = addr;
+      is_socket = true;
+    }
+    else {
+      fd = ::open(sink.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+      is_socket = false;
+    }
+    if(fd < 0){
+      cerr<<"ERROR: cannot open metrics output "<<sink<<endl;
+      return false;
+    }
+    return true;
+  }
+
+  void start(){
+    start_time = last_time = chrono::steady_clock::now();
+    next_report = start_time + chrono::duration_cast<chrono::steady_clock::duration>
+      (chrono::duration<double>(interval));
+  }
+
+  // Time spent in a stage, from any thread
+  void add_stage(int stage, long ns){
+    stage_ns[stage].fetch_add(ns, memory_order_relaxed);
+  }
+
+  // Failed generator calls, per generator (cumulative)
+  void set_gen_errors(int igen, int n){
+    if(igen >= int(gen_errors.size()))
+      gen_errors.resize(igen + 1, 0);
+    gen_errors[igen] = n;
+  }
+
+  // Counts so far, sigma in pb
+  void set_counts(long tried, long pass, double sigma_pb, double sigma_err_pb, long over){
+    n_tried = tried;
+    n_pass = pass;
+    sigma = sigma_pb;
+    sigma_err = sigma_err_pb;
+    n_over = over;
+  }
+
+  // After every tried event, from the thread that counts them; reports
+  // once the interval has passed
+  void update(long tried, long pass, double sigma_pb, double sigma_err_pb, long over){
+    set_counts(tried, pass, sigma_pb, sigma_err_pb, over);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if(now >= next_report){
+      report(now, "running");
+      next_report = now + chrono::duration_cast<chrono::steady_clock::duration>
+        (chrono::duration<double>(interval));
+    }
+  }
+
+  // The last report, with the run's final status
+  void finish(const string& status){
+    report(chrono::steady_clock::now(), status);
+  }
+
+private:
+
+  int fd;
+  bool is_socket;
+  struct sockaddr_un socket_addr;
+
+  long n_tried, n_pass;
+  double sigma, sigma_err;
+  long n_over;
+  vector<int> gen_errors;
+  atomic<long> stage_ns[STAGE_NSTAGE];
+
+  // rates averaged over about three reports, -1 before the first
+  double rate_tried, rate_pass;
+  long last_tried, last_pass;
+  chrono::steady_clock::time_point start_time, last_time, next_report;
+
+  RunMetrics(const RunMetrics&);
+
+  void average(double& rate, double instant, double dt){
+    if(rate < 0)
+      rate = instant;
+    else
+      rate += (1 - exp(-dt/(3*interval)))*(instant - rate);
+  }
+
+  void report(chrono::steady_clock::time_point now, const string& status){
+    double dt = chrono::duration<double>(now - last_time).count();
+    if(dt > 0){
+      average(rate_tried, (n_tried - last_tried)/dt, dt);
+      average(rate_pass, (n_pass - last_pass)/dt, dt);
+    }
+    last_time = now;
+    last_tried = n_tried;
+    last_pass = n_pass;
+
+    double elapsed = chrono::duration<double>(now - start_time).count();
+    double eff = n_tried > 0 ? double(n_pass)/n_tried : 0;
+    double eff_err = n_tried > 0 ? sqrt(eff*(1 - eff)/n_tried) : 0;
+
+    double eta = -1;
+    double rate = target_pass ? rate_pass : rate_tried;
+    long done = target_pass ? n_pass : n_tried;
+    if(status != "running")
+      eta = 0;
+    else if(target > 0 && rate > 0)
+      eta = max(0L, target - done)/rate;
+
+    int errors = 0;
+    for(size_t g=0; g<gen_errors.size(); ++g)
+      errors += gen_errors[g];
+
+    if(console){
+      ostringstream sout;
+      sout << "INFO: ";
+      if(target > 0)
+        sout << fixed << setprecision(1) << 100.*done/target << "% of " << target
+             << (target_pass ? " accepted" : " tried") << ", ";
+      sout << n_tried << " tried, " << n_pass << " accepted, "
+           << setprecision(1) << fixed << max(0., rate_tried) << " evt/s, eff "
+           << defaultfloat << setprecision(4) << eff << " +- " << setprecision(2) << eff_err;
+      if(eta >= 0 && status == "running")
+        sout << ", ETA " << duration_text(eta);
+      if(status != "running")
+        sout << ", " << status << " after " << duration_text(elapsed);
+      cout << sout.str() << endl;
+    }
+
+    if(fd < 0)
+      return;
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    const char* stage_names[STAGE_NSTAGE] = {"generation", "detector", "selection"};
+
+    ostringstream out;
+    out << setprecision(6);
+    out << "{\"job\":\"" << json_escape(job) << "\",\"host\":\"" << json_escape(host)
+        << "\",\"pid\":" << getpid() << ",\"worker\":" << worker
+        << ",\"time\":" << long(time(NULL)) << ",\"elapsed\":" << json_number(elapsed)
+        << ",\"status\":\"" << status << "\""
+        << ",\"n_tried\":" << n_tried << ",\"n_pass\":" << n_pass
+        << ",\"target\":" << target << ",\"target_kind\":\"" << (target_pass ? "pass" : "tried") << "\""
+        << ",\"rate_tried\":" << json_number(max(0., rate_tried))
+        << ",\"rate_pass\":" << json_number(max(0., rate_pass))
+        << ",\"eff\":" << json_number(eff) << ",\"eff_err\":" << json_number(eff_err)
+        << ",\"sigma_pb\":" << json_number(sigma) << ",\"sigma_err_pb\":" << json_number(sigma_err)
+        << ",\"eta_sec\":" << json_number(eta) << ",\"sec_per_evt\":{";
+    for(int s=0; s<STAGE_NSTAGE; ++s)
+      out << (s ? "," : "") << "\"" << stage_names[s] << "\":"
+          << json_number(n_tried > 0 ? stage_ns[s].load()*1e-9/n_tried : 0);
+    out << "},\"rss_mb\":" << json_number(current_rss_mb())
+        << ",\"max_rss_mb\":" << json_number(cost_max_rss_mb())
+        << ",\"gen_errors\":" << errors << ",\"n_over_budget\":" << n_over << "}\n";
+
+    string line = out.str();
+    if(is_socket)
+      sendto(fd, line.data(), line.size(), MSG_DONTWAIT,
+             (struct sockaddr*) &socket_addr, sizeof(socket_addr));
+    else if(write(fd, line.data(), line.size()) < 0)
+      cerr<<"WARNING: cannot write metrics"<<endl;
+  }
+};
+
+// Adds the time until the end of the scope to a stage
+class StageTimer {
+public:
+  StageTimer(RunMetrics& metrics, MetricStage stage):
+    metrics(metrics), stage(stage), start(chrono::steady_clock::now()) {}
+  ~StageTimer(){
+    metrics.add_stage(stage, chrono::duration_cast<chrono::nanoseconds>
+                      (chrono::steady_clock::now() - start).count());
+  }
+private:
+  RunMetrics& metrics;
+  MetricStage stage;
+  chrono::steady_clock::time_point start;
+};
+
+#endif
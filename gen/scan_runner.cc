@@ -0,0 +1,550 @@
+// Run a grid of monojet.exe jobs on one machine
+//
+// Usage: scan_runner [-j (cores)] [-exe ./monojet.exe] [-oversub (4)]
+//                    [-max_shards (64)] [-cost_db cost.db] [-resume] grid.txt
+//
+// Each line of the grid file is one point,
+//
+//   name [cost=C] [shards=S] -m lhe -i events.lhe -lambda 10 -inv 0.3 ...
+//
+// with the monojet.exe options after the name.  Points are split into
+// (point, shard) tasks, either S shards or as many as needed to bring
+// each task down to about total cost / (cores * oversub), so that
+// expensive points run spread over many cores.  Shards split -n (and
+// -nmin/-nmax) between them, select their block of an LHE file with
+// -nshard/-ishard and get their own seeds from -seed_key (the point
+// name unless given), or from -seed and the shard number.
+//
+// Tasks are dealt to one queue per worker, most expensive first; a
+// worker takes from the front of its own queue and, once empty, steals
+// from the back of the fullest other one.  When the last shard of a
+// point finishes, its outputs are merged into name.evt, name.meta, ...
+// as a single run would have written them.  grid.txt.status lists the
+// state of every point, and -resume skips those already done.
+//
+// SIGTERM and SIGINT are passed on to the running shards as SIGTERM, so
+// that they stop at an event boundary; the runner waits for them, starts
+// no new task and marks the unfinished points interrupted.
+//
+// With -cost_db, points without cost= get the core-seconds predicted
+// from earlier runs (see cost_db.h), are not split into shards shorter
+// than their initialization, and every shard adds its own cost to the
+// database.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#include "CmdLine/CmdLine.hh"
+#include "shard_merge.h"
+#include "cost_db.h"
+#include "seeds.h"
+
+using namespace std;
+
+struct ScanPoint {
+  string name;
+  double cost;          // negative until given or predicted
+  double init_cost;     // paid again by every shard
+  int nshard;
+  vector<string> args;
+
+  // progress
+  int ndone, nfailed;
+  double seconds;       // summed over the shards
+  string state;         // pending, running, done, failed, interrupted
+
+  ScanPoint(): cost(-1), init_cost(0), nshard(0), ndone(0), nfailed(0), seconds(0),
+    state("pending") {}
+};
+
+struct ScanTask {
+  int point, shard;
+  double cost;
+
+  bool operator<(const ScanTask& other) const {return cost > other.cost;}
+};
+
+// One deque of tasks per worker
+class StealingQueues {
+
+public:
+
+  StealingQueues(int nworker): queues(nworker), locks(nworker) {}
+
+  void push(int w, const ScanTask& task){
+    lock_guard<mutex> lock(locks[w]);
+    queues[w].push_back(task);
+  }
+
+  // Next task of worker w, stolen from another worker if needed
+  bool pop(int w, ScanTask& task){
+    {
+      lock_guard<mutex> lock(locks[w]);
+      if(!queues[w].empty()){
+        task = queues[w].front();
+        queues[w].pop_front();
+        return true;
+      }
+    }
+
+    while(true){
+      int victim = -1;
+      size_t most = 0;
+      for(size_t v=0; v<queues.size(); ++v){
+        lock_guard<mutex> lock(locks[v]);
+        if(queues[v].size() > most){
+          most = queues[v].size();
+          victim = v;
+        }
+      }
+      if(victim < 0)
+        return false;
+
+      lock_guard<mutex> lock(locks[victim]);
+      if(!queues[victim].empty()){
+        task = queues[victim].back();
+        queues[victim].pop_back();
+        return true;
+      }
+    }
+  }
+
+private:
+
+  vector<deque<ScanTask> > queues;
+  vector<mutex> locks;
+};
+
+bool read_grid(const string& fname, vector<ScanPoint>& points){
+  ifstream fin(fname.c_str());
+  if(!fin.good()){
+    cerr<<"ERROR: cannot read grid "<<fname<<endl;
+    return false;
+  }
+
+  string line;
+  while(getline(fin, line)){
+    size_t comment = line.find('#');
+    if(comment != string::npos)
+      line = line.substr(0, comment);
+
+    istringstream sin(line);
+    ScanPoint point;
+    if(!(sin >> point.name))
+      continue;
+
+    string word;
+    while(sin >> word){
+      if(!point.args.empty() || word[0] == '-')
+        point.args.push_back(word);
+      else if(word.compare(0, 5, "cost=") == 0)
+        point.cost = atof(word.c_str() + 5);
+      else if(word.compare(0, 7, "shards=") == 0)
+        point.nshard = atoi(word.c_str() + 7);
+      else {
+        cerr<<"ERROR: unknown setting "<<word<<" of point "<<point.name<<endl;
+        return false;
+      }
+    }
+    points.push_back(point);
+  }
+  return true;
+}
+
+// Value of option opt in args, or -1
+int find_option(const vector<string>& args, const string& opt){
+  for(size_t i=0; i+1<args.size(); ++i)
+    if(args[i] == opt)
+      return i + 1;
+  return -1;
+}
+
+// Command line of a shard
+vector<string> shard_args(const string& exe, const ScanPoint& point, int shard){
+  vector<string> args(1, exe);
+  args.insert(args.end(), point.args.begin(), point.args.end());
+
+  int n = point.nshard;
+  if(n > 1){
+    // monojet.exe's defaults are for the whole point
+    const char* counts[] = {"-n", "-nmin", "-nmax"};
+    const char* defaults[] = {"1000", "1000", "10000000"};
+    for(int k=0; k<3; ++k){
+      if(find_option(args, counts[k]) < 0){
+        args.push_back(counts[k]);
+        args.push_back(defaults[k]);
+      }
+      int i = find_option(args, counts[k]);
+      args[i] = to_string(WorkerPool::share(atol(args[i].c_str()), shard, n));
+    }
+
+    // the shards' precisions add up
+    int i = find_option(args, "-target_err");
+    if(i >= 0)
+      args[i] = to_string(atof(args[i].c_str())*sqrt(double(n)));
+
+    args.push_back("-nshard");
+    args.push_back(to_string(n));
+    args.push_back("-ishard");
+    args.push_back(to_string(shard));
+
+    // a fixed -seed would give every shard the same events
+    i = find_option(args, "-seed");
+    if(i >= 0 && find_option(args, "-seed_key") < 0 && atol(args[i].c_str()) >= 0)
+      args[i] = to_string(derive_seed(atol(args[i].c_str()), "shard", shard));
+  }
+
+  if(find_option(args, "-seed_key") < 0 && find_option(args, "-seed") < 0){
+    args.push_back("-seed_key");
+    args.push_back(point.name);
+  }
+
+  args.push_back("-o");
+  args.push_back(n > 1 ? point.name + ".shard" + to_string(shard) : point.name);
+  return args;
+}
+
+// Signal received, 0 if none, and the shard run by each worker, 0 if
+// none, for the handler to pass it on
+static volatile sig_atomic_t stop_signal = 0;
+static volatile sig_atomic_t* running_pids = NULL;
+static int nrunning_pids = 0;
+
+void stop_handler(int sig){
+  stop_signal = sig;
+  for(int w=0; w<nrunning_pids; ++w)
+    if(running_pids[w] > 0)
+      kill(running_pids[w], SIGTERM);
+}
+
+// Run a command with its output going to log, true if it succeeded.
+// slot is the worker's entry of running_pids.
+bool run_command(const vector<string>& args, const string& log, int slot){
+  // everything is allocated before fork: another worker thread may
+  // hold the malloc lock, so the child only calls async-signal-safe
+  // functions
+  vector<char*> argv;
+  for(size_t i=0; i<args.size(); ++i)
+    argv.push_back(const_cast<char*>(args[i].c_str()));
+  argv.push_back(NULL);
+
+  pid_t pid = fork();
+  if(pid < 0){
+    cerr<<"ERROR: cannot fork"<<endl;
+    return false;
+  }
+
+  if(pid == 0){
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0){
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+    }
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  // signalled while forking
+  running_pids[slot] = pid;
+  if(stop_signal)
+    kill(pid, SIGTERM);
+
+  int status;
+  bool waited = true;
+  while(waitpid(pid, &status, 0) < 0)
+    if(errno != EINTR){
+      waited = false;
+      break;
+    }
+  running_pids[slot] = 0;
+  return waited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Merge the outputs of all shards of a point, found next to the first
+// one (name.shard0.evt, name.shard0_CMS.meta, ...)
+bool merge_point(const ScanPoint& point){
+  string dir = ".", base = point.name;
+  size_t slash = base.rfind('/');
+  if(slash != string::npos){
+    dir = base.substr(0, slash);
+    base = base.substr(slash + 1);
+  }
+  string first = base + ".shard0";
+
+  vector<string> suffixes;
+  DIR* d = opendir(dir.c_str());
+  if(!d)
+    return false;
+  while(struct dirent* entry = readdir(d)){
+    string fname = entry->d_name;
+    if(fname.compare(0, first.size(), first) != 0)
+      continue;
+    string suffix = fname.substr(first.size());
+    if(suffix.size() && suffix[0] != '.' && suffix[0] != '_')
+      continue;   // shard01...
+    if(suffix != ".log")
+      suffixes.push_back(suffix);
+  }
+  closedir(d);
+
+  // .meta first, it normalizes the rest of its detector
+  sort(suffixes.begin(), suffixes.end());
+  map<string, vector<pair<string, double> > > infos;
+  const string exts[] = {".meta", ".evt", ".hist.json", ".objs"};
+
+  bool ok = true;
+  for(int k=0; k<4; ++k)
+    for(size_t s=0; s<suffixes.size(); ++s){
+      const string& suffix = suffixes[s];
+      if(suffix.size() < exts[k].size() ||
+         suffix.compare(suffix.size() - exts[k].size(), exts[k].size(), exts[k]) != 0)
+        continue;
+      string stem = suffix.substr(0, suffix.size() - exts[k].size());
+
+      vector<string> parts;
+      for(int i=0; i<point.nshard; ++i)
+        parts.push_back(point.name + ".shard" + to_string(i) + suffix);
+      string output = point.name + suffix;
+
+      bool merged;
+      if(k == 0)
+        merged = merge_meta(parts, output, infos[stem]);
+      else if(k == 1)
+        merged = merge_evt(parts, output);
+      else if(k == 2)
+        merged = merge_hists(parts, output, infos[stem]);
+      else
+        merged = merge_store(parts, output, infos[stem]);
+
+      if(merged)
+        for(size_t i=0; i<parts.size(); ++i)
+          remove(parts[i].c_str());
+      ok = ok && merged;
+    }
+  return ok;
+}
+
+void write_status(const string& fname, const vector<ScanPoint>& points){
+  ofstream fout((fname + ".tmp").c_str());
+  fout<<"# name state shards done failed seconds"<<endl;
+  for(size_t i=0; i<points.size(); ++i){
+    const ScanPoint& p = points[i];
+    fout<<p.name<<" "<<p.state<<" "<<p.nshard<<" "<<p.ndone<<" "
+        <<p.nfailed<<" "<<p.seconds<<endl;
+  }
+  fout.close();
+  rename((fname + ".tmp").c_str(), fname.c_str());
+}
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  int nworker = cmdline.value<int>("-j", thread::hardware_concurrency());
+  string exe = cmdline.value<string>("-exe", "./monojet.exe");
+  double oversub = cmdline.value<double>("-oversub", 4);
+  int max_shards = cmdline.value<int>("-max_shards", 64);
+  bool resume = cmdline.present("-resume");
+  string cost_db = cmdline.value<string>("-cost_db", "");
+
+  // the grid is the argument that is neither an option nor its value
+  string grid;
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i] == "-resume")
+      continue;
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    grid = args[i];
+  }
+
+  if(grid == "" || nworker < 1){
+    cerr<<"Usage: scan_runner [-j (cores)] [-exe ./monojet.exe] [-oversub (4)] "
+        <<"[-max_shards (64)] [-cost_db cost.db] [-resume] grid.txt"<<endl;
+    return 1;
+  }
+
+  vector<ScanPoint> points;
+  if(!read_grid(grid, points))
+    return 1;
+  string status_file = grid + ".status";
+
+  // Costs of the points without cost=, from the runs so far
+  CostModel cost_model;
+  if(cost_db != "" && ifstream(cost_db.c_str()).good() && !cost_model.read(cost_db))
+    return 1;
+  int npredicted = 0;
+  for(size_t i=0; i<points.size(); ++i){
+    ScanPoint& p = points[i];
+    if(cost_db == "")
+      continue;
+    if(p.cost < 0){
+      vector<string> point_args(1, exe);
+      point_args.insert(point_args.end(), p.args.begin(), p.args.end());
+      CostRecord predicted;
+      double cost = cost_model.run_cost(CmdLine(point_args), predicted);
+      if(cost >= 0){
+        p.cost = cost;
+        p.init_cost = predicted.get("init_sec");
+        ++npredicted;
+      }
+    }
+    if(find_option(p.args, "-cost_db") < 0){
+      p.args.push_back("-cost_db");
+      p.args.push_back(cost_db);
+    }
+  }
+  if(cost_db != "")
+    cout<<"INFO: predicted the cost of "<<npredicted<<" points from "
+        <<cost_model.records.size()<<" runs in "<<cost_db<<endl;
+  for(size_t i=0; i<points.size(); ++i)
+    if(points[i].cost < 0)
+      points[i].cost = 1;
+
+  // points already done in an earlier run
+  if(resume){
+    ifstream fin(status_file.c_str());
+    string name, state, line;
+    map<string, string> states;
+    while(getline(fin, line)){
+      istringstream sin(line);
+      if(sin >> name >> state && name[0] != '#')
+        states[name] = state;
+    }
+    for(size_t i=0; i<points.size(); ++i)
+      if(states[points[i].name] == "done")
+        points[i].state = "done";
+  }
+
+  // Shards: cost of a task about total / (cores * oversub)
+  double total_cost = 0;
+  for(size_t i=0; i<points.size(); ++i)
+    if(points[i].state != "done")
+      total_cost += points[i].cost;
+  double task_cost = total_cost/(nworker*oversub);
+
+  vector<ScanTask> tasks;
+  for(size_t i=0; i<points.size(); ++i){
+    ScanPoint& p = points[i];
+    if(p.nshard <= 0){
+      p.nshard = task_cost > 0 ? int(ceil(p.cost/task_cost - 1e-9)) : 1;
+      // no shard spending more on its initialization than on events
+      if(p.init_cost > 0)
+        p.nshard = min(p.nshard, max(1, int((p.cost - p.init_cost)/p.init_cost)));
+    }
+    p.nshard = max(1, min(p.nshard, max_shards));
+    if(p.state == "done")
+      continue;
+    for(int s=0; s<p.nshard; ++s){
+      ScanTask task = {int(i), s, p.init_cost + (p.cost - p.init_cost)/p.nshard};
+      tasks.push_back(task);
+    }
+  }
+
+  // most expensive first, dealt round robin
+  stable_sort(tasks.begin(), tasks.end());
+  StealingQueues queues(nworker);
+  for(size_t t=0; t<tasks.size(); ++t)
+    queues.push(t % nworker, tasks[t]);
+
+  cout<<"INFO: "<<tasks.size()<<" tasks of "<<points.size()<<" points on "
+      <<nworker<<" workers"<<endl;
+
+  mutex progress_lock;
+  atomic<int> npoints_done(0), npoints_failed(0);
+  write_status(status_file, points);
+
+  running_pids = new sig_atomic_t[nworker]();
+  nrunning_pids = nworker;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  vector<thread> workers;
+  for(int w=0; w<nworker; ++w)
+    workers.push_back(thread([&, w](){
+      ScanTask task;
+      while(!stop_signal && queues.pop(w, task)){
+        ScanPoint& p = points[task.point];
+        {
+          lock_guard<mutex> lock(progress_lock);
+          p.state = "running";
+        }
+
+        vector<string> cmd = shard_args(exe, p, task.shard);
+        string log = (p.nshard > 1 ? p.name + ".shard" + to_string(task.shard)
+                      : p.name) + ".log";
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool ok = run_command(cmd, log, w);
+        double seconds = chrono::duration<double>
+          (chrono::steady_clock::now() - start).count();
+
+        bool last;
+        {
+          lock_guard<mutex> lock(progress_lock);
+          ++p.ndone;
+          p.nfailed += !ok;
+          p.seconds += seconds;
+          last = p.ndone == p.nshard;
+          if(!ok)
+            cerr<<"ERROR: "<<p.name<<" shard "<<task.shard<<" failed, see "<<log<<endl;
+        }
+        if(!last)
+          continue;
+
+        // outputs of a complete point
+        bool merged = p.nfailed == 0 && (p.nshard == 1 || merge_point(p));
+
+        lock_guard<mutex> lock(progress_lock);
+        p.state = merged ? "done" : stop_signal ? "interrupted" : "failed";
+        ++(merged ? npoints_done : npoints_failed);
+        cout<<"INFO: "<<p.name<<" "<<p.state<<" in "<<p.seconds<<" s ("
+            <<npoints_done + npoints_failed<<" points finished)"<<endl;
+        write_status(status_file, points);
+      }
+    }));
+
+  for(int w=0; w<nworker; ++w)
+    workers[w].join();
+
+  if(stop_signal){
+    for(size_t i=0; i<points.size(); ++i)
+      if(points[i].state == "running" || points[i].state == "pending")
+        points[i].state = "interrupted";
+    write_status(status_file, points);
+    cerr<<"ERROR: stopped by "<<(stop_signal == SIGINT ? "SIGINT" : "SIGTERM")<<endl;
+    return 1;
+  }
+
+  cout<<"INFO: "<<npoints_done<<" points done, "<<npoints_failed<<" failed"<<endl;
+  return npoints_failed > 0 ? 1 : 0;
+}
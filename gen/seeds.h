@@ -0,0 +1,50 @@
+#ifndef __seeds_h
+#define __seeds_h
+
+// Reproducible, distinct random seeds for grid jobs
+//
+// A job is identified by a key (run label, grid coordinates, shard),
+// e.g. "scan1/lambda=10/inv=0.3/shard=2", hashed into Pythia's seed
+// range 1..900000000.  The random streams inside a job (forked workers,
+// extra generators, Delphes' gRandom) get their own seeds hashed from
+// the job seed, the stream name and the index, so that no two streams
+// of a scan start from the same seed unless the hash collides, which
+// scan_dark.py checks over the whole scan before submitting.
+
+#include <string>
+#include <sstream>
+#include <random>
+#include <chrono>
+
+#include <unistd.h>
+
+#include "hash.h"
+
+using namespace std;
+
+static const long pythia_seed_max = 900000000;
+
+// Seed of a job, from its key
+long derive_seed(const string& key){
+  return 1 + long(Hasher().add(key).value % pythia_seed_max);
+}
+
+// Seed of a run asking for a different one every time (-seed -1):
+// drawn once from the system entropy, the clock and the pid, so that
+// the streams derived from it differ between runs too
+long random_seed(){
+  random_device device;
+  ostringstream key;
+  key << device() << "/" << chrono::system_clock::now().time_since_epoch().count()
+      << "/" << getpid();
+  return derive_seed(key.str());
+}
+
+// Seed of stream index of a job, e.g. ("worker", 3)
+long derive_seed(long seed, const string& stream, int index){
+  ostringstream key;
+  key << seed << "/" << stream << "/" << index;
+  return derive_seed(key.str());
+}
+
+#endif
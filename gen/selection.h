@@ -0,0 +1,111 @@
+#ifndef __selection_h
+#define __selection_h
+
+// Monojet selection cuts and the .evt row they produce, shared by
+// monojet.exe and the offline reselect tool
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "CmdLine/CmdLine.hh"
+
+using namespace std;
+
+// Event selection
+struct SelectionCuts {
+  double pt_min;      // leading jet pT
+  double met_min, met_max;
+  double dphi_min;    // min dphi between MET and the 4 leading jets
+  bool lepton_veto;
+  int njet, njet_max;
+  bool Zprime;        // recluster into C/A R=1.1 jets
+
+  double jet_pt, jet_eta;
+  double muon_pt, muon_eta;
+  double electron_pt, electron_eta;
+
+  SelectionCuts(): pt_min(0), met_min(0), met_max(99999), dphi_min(0),
+    lepton_veto(true), njet(1), njet_max(100), Zprime(false),
+    jet_pt(30.0), jet_eta(2.8), muon_pt(10), muon_eta(2.5),
+    electron_pt(20), electron_eta(2.5) {}
+};
+
+// Cuts from the command line, same options as monojet.exe
+void read_cuts(const CmdLine& cmdline, SelectionCuts& cuts){
+  cuts.pt_min = cmdline.value<double>("-ptmin", 0);
+  cuts.met_min = cmdline.value<double>("-metmin", 0);
+  cuts.met_max = cmdline.value<double>("-metmax", 99999);
+  cuts.dphi_min = cmdline.value<double>("-dphimin", 0);
+  cuts.lepton_veto = cmdline.value<bool>("-lveto", true);
+  cuts.Zprime = cmdline.present("-Zprime");
+
+  // Demand at least njet jets above jet_pt
+  cuts.njet = cmdline.value<int>("-njet", 1);
+  cuts.njet_max = cmdline.value<int>("-njetmax", 100);
+  cuts.jet_pt = cmdline.value<double>("-jetpt", 30.0);
+  cuts.jet_eta = cmdline.value<double>("-jeteta", 2.8);
+
+  if(cuts.njet < 0){
+    cout<<"ERROR: cannot require negative jets"<<endl;
+    cuts.njet = 0;
+  }
+}
+
+// One line of the .evt file, in the column order of the header: the
+// standard columns, then any extra ones (e.g. reclustered jets)
+struct EvtRow {
+
+  enum {evt, MEt, mjj, Mt, pt1, eta1, y1, pt2, eta2, y2,
+        pt3, eta3, y3, pt4, eta4, y4, dphi, nj, n_meson, n_glu, ncol};
+
+  vector<double> v;
+  double weight;
+
+  // names of the columns after the standard ones
+  vector<string> extra;
+
+  EvtRow(): v(ncol, 0), weight(1) {}
+
+  void add_columns(const vector<string>& names){
+    extra.insert(extra.end(), names.begin(), names.end());
+    v.resize(ncol + extra.size(), 0);
+  }
+
+  vector<string> column_names() const {
+    static const char* const columns[ncol] = {"evt", "MEt", "mjj", "Mt",
+      "pt1", "eta1", "y1", "pt2", "eta2", "y2",
+      "pt3", "eta3", "y3", "pt4", "eta4", "y4",
+      "dphi", "nj", "n_meson", "n_glu"};
+    vector<string> names(columns, columns + ncol);
+    names.insert(names.end(), extra.begin(), extra.end());
+    return names;
+  }
+
+  // out is a CsvWriter, or any ostream
+  template<class Out> void write_header(Out& out, bool weighted) const {
+    out << "evt,MEt,mjj,Mt,pt1,eta1,y1,pt2,eta2,y2,pt3,eta3,y3,pt4,eta4,y4,dphi,"
+        << "nj,n_meson,n_glu";
+    for(size_t i=0; i<extra.size(); ++i)
+      out << "," << extra[i];
+    if(weighted)
+      out << ", weight";
+    out << "\n";
+  }
+
+  template<class Out> void write_csv(Out& out, bool weighted) const {
+    out << long(v[evt]);
+    for(int i=MEt; i<nj; ++i)
+      out << "," << v[i];
+    out << "," << long(v[nj])
+        << "," << long(v[n_meson])
+        << "," << long(v[n_glu]);
+    for(size_t i=ncol; i<v.size(); ++i)
+      out << "," << v[i];
+    if(weighted)
+      out << ", " << weight;
+    out << "\n";
+  }
+};
+
+#endif
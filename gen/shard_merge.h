@@ -0,0 +1,205 @@
+#ifndef __shard_merge_h
+#define __shard_merge_h
+
+// Merging the outputs of the shards of one grid point into the files a
+// single run would have written (used by scan_runner)
+//
+//   .meta       counts summed, cxn combined, lhe_eof and-ed, status
+//               the worst of the shards; other columns kept when all
+//               shards agree, dropped otherwise
+//   .evt        rows concatenated with the evt column renumbered
+//   .hist.json  bins summed, info from the merged .meta
+//   .objs       blocks concatenated, info from the merged .meta
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+#include "histograms.h"
+#include "object_store.h"
+#include "multiproc.h"
+#include "cxn_combine.h"
+#include "evt_merge.h"
+
+using namespace std;
+
+// The two lines of a .meta file
+struct MetaTable {
+  vector<string> columns, values;
+
+  bool read(const string& fname){
+    ifstream fin(fname.c_str());
+    string header, row;
+    if(!getline(fin, header) || !getline(fin, row))
+      return false;
+    columns = split(header);
+    values = split(row);
+    return columns.size() == values.size();
+  }
+
+  int find(const string& column) const {
+    for(size_t i=0; i<columns.size(); ++i)
+      if(columns[i] == column)
+        return i;
+    return -1;
+  }
+
+  double number(const string& column, double def = 0) const {
+    int i = find(column);
+    return i < 0 ? def : atof(values[i].c_str());
+  }
+
+  static vector<string> split(const string& line){
+    vector<string> items;
+    stringstream sin(line);
+    string item;
+    while(getline(sin, item, ',')){
+      size_t b = item.find_first_not_of(" \t\r");
+      size_t e = item.find_last_not_of(" \t\r");
+      items.push_back(b == string::npos ? "" : item.substr(b, e - b + 1));
+    }
+    return items;
+  }
+};
+
+// Merge the .meta files of the shards; info gets the normalization
+// for the histograms and object stores of the same detector
+bool merge_meta(const vector<string>& parts, const string& output,
+                vector<pair<string, double> >& info){
+  vector<MetaTable> metas(parts.size());
+  for(size_t i=0; i<parts.size(); ++i)
+    if(!metas[i].read(parts[i])){
+      cerr<<"ERROR: cannot read "<<parts[i]<<endl;
+      return false;
+    }
+
+  const char* sums[] = {"nevt", "npass", "total", "pass", "sum_weight"};
+  MetaTable merged = metas[0];
+  CxnCombiner combined;
+  for(size_t i=0; i<metas.size(); ++i)
+    combined.add(metas[i].number("cxn"), metas[i].number("cxn_err"),
+                 metas[i].number("nevt"));
+
+  vector<string> columns, values;
+  for(size_t c=0; c<merged.columns.size(); ++c){
+    const string& column = merged.columns[c];
+    ostringstream value;
+    value << setprecision(12);
+
+    bool sum = false;
+    for(size_t k=0; k<sizeof(sums)/sizeof(sums[0]); ++k)
+      sum = sum || column == sums[k];
+
+    if(sum){
+      double total = 0;
+      for(size_t i=0; i<metas.size(); ++i)
+        total += metas[i].number(column);
+      value << total;
+    }
+    else if(column == "eff"){
+      double nevt = 0, npass = 0;
+      for(size_t i=0; i<metas.size(); ++i){
+        nevt += metas[i].number("nevt");
+        npass += metas[i].number("npass");
+      }
+      value << (nevt > 0 ? npass/nevt : 0);
+    }
+    else if(column == "cxn")
+      value << combined.cxn();
+    else if(column == "cxn_err")
+      value << combined.err();
+    else if(column == "status"){
+      // complete < interrupted < aborted
+      string status = "complete";
+      for(size_t i=0; i<metas.size(); ++i){
+        int j = metas[i].find(column);
+        string s = j < 0 ? "aborted" : metas[i].values[j];
+        if(s == "aborted" || (s == "interrupted" && status == "complete"))
+          status = s;
+      }
+      value << status;
+    }
+    else if(column == "lhe_eof"){
+      bool eof = true;
+      for(size_t i=0; i<metas.size(); ++i)
+        eof = eof && metas[i].number(column) != 0;
+      value << (eof ? 1 : 0);
+    }
+    else {
+      bool same = true;
+      for(size_t i=1; i<metas.size(); ++i){
+        int j = metas[i].find(column);
+        same = same && j >= 0 && metas[i].values[j] == merged.values[c];
+      }
+      if(!same)
+        continue;
+      value << merged.values[c];
+    }
+
+    columns.push_back(column);
+    values.push_back(value.str());
+  }
+
+  ofstream fout(output.c_str());
+  for(size_t c=0; c<columns.size(); ++c)
+    fout << (c ? ", " : "") << columns[c];
+  fout << endl;
+  for(size_t c=0; c<values.size(); ++c)
+    fout << (c ? "," : "") << values[c];
+  fout << endl;
+  if(!fout.good()){
+    cerr<<"ERROR: cannot write "<<output<<endl;
+    return false;
+  }
+
+  MetaTable result;
+  result.columns = columns;
+  result.values = values;
+  info.clear();
+  info.push_back(make_pair("nevt", result.number("nevt")));
+  info.push_back(make_pair("npass", result.number("npass")));
+  info.push_back(make_pair("cxn", result.number("cxn")));
+  info.push_back(make_pair("cxn_err", result.number("cxn_err")));
+  if(result.find("sum_weight") >= 0)
+    info.push_back(make_pair("sum_weight", result.number("sum_weight")));
+  return true;
+}
+
+// Concatenate the .evt files of the shards under the header of the first
+bool merge_evt(const vector<string>& parts, const string& output, int nthread = 1){
+  return merge_evt_files(parts, output, false, nthread);
+}
+
+bool merge_hists(const vector<string>& parts, const string& output,
+                 const vector<pair<string, double> >& info){
+  HistogramSet merged;
+  for(size_t i=0; i<parts.size(); ++i){
+    HistogramSet hists;
+    if(!hists.read_json(parts[i]) || (i > 0 && !merged.add(hists))){
+      cerr<<"ERROR: cannot merge histograms of "<<parts[i]<<endl;
+      return false;
+    }
+    if(i == 0)
+      merged = hists;
+  }
+  return merged.write_json(output, info);
+}
+
+bool merge_store(const vector<string>& parts, const string& output,
+                 const vector<pair<string, double> >& info){
+  ObjectStoreWriter store;
+  if(!store.open(output))
+    return false;
+  for(size_t i=0; i<parts.size(); ++i)
+    if(!append_store_part(store, parts[i])){
+      cerr<<"ERROR: cannot read object store "<<parts[i]<<endl;
+      return false;
+    }
+  return store.close(info);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __shutdown_h
+#define __shutdown_h
+
+// Graceful shutdown on SIGTERM and SIGUSR1
+//
+// Batch systems signal a job some time before killing it.  The handler
+// only records the signal; the event loop stops at the next event
+// boundary and the run ends as a complete one would: Delphes finished,
+// HepMC closed, .evt, .hist.json and .objs flushed and a .meta whose
+// counters and cross section cover the events tried so far.  Its status
+// column tells such partial runs apart:
+//
+//   complete      the run reached -n, the end of its input or its target
+//   interrupted   stopped by a signal
+//   aborted       stopped after too many generator errors
+//
+// Forked workers inherit the handlers; the parent also passes the
+// signal on to them, in case only it was signalled.
+
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/types.h>
+
+using namespace std;
+
+enum RunStatus {RUN_COMPLETE, RUN_INTERRUPTED, RUN_ABORTED};
+
+const char* run_status_name(int status){
+  switch(status){
+  case RUN_COMPLETE: return "complete";
+  case RUN_INTERRUPTED: return "interrupted";
+  default: return "aborted";
+  }
+}
+
+// Last signal received, 0 if none
+volatile sig_atomic_t stop_signal = 0;
+
+// Workers to pass the signal on to, set in the parent
+static pid_t stop_forward_pids[256];
+static volatile sig_atomic_t stop_forward_n = 0;
+
+void stop_handler(int sig){
+  stop_signal = sig;
+  for(int i=0; i<stop_forward_n; ++i)
+    kill(stop_forward_pids[i], sig);
+}
+
+bool stop_requested(){return stop_signal != 0;}
+
+const char* stop_signal_name(){
+  return stop_signal == SIGUSR1 ? "SIGUSR1" : "SIGTERM";
+}
+
+// SA_RESTART: a signal must not turn a blocking read of an LHE stream
+// into a premature end of file
+void install_stop_handlers(){
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGUSR1, &sa, NULL);
+}
+
+void forward_stop_signals(const vector<pid_t>& pids){
+  stop_forward_n = 0;
+  for(size_t i=0; i<pids.size() && i<sizeof(stop_forward_pids)/sizeof(pid_t); ++i)
+    stop_forward_pids[i] = pids[i];
+  stop_forward_n = min(pids.size(), sizeof(stop_forward_pids)/sizeof(pid_t));
+
+  // signalled while forking
+  if(stop_signal)
+    for(int i=0; i<stop_forward_n; ++i)
+      kill(stop_forward_pids[i], stop_signal);
+}
+
+#endif
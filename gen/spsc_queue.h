@@ -0,0 +1,94 @@
+#ifndef __spsc_queue_h
+#define __spsc_queue_h
+
+// Bounded single-producer/single-consumer ring buffer
+//
+// The slots are preallocated and filled in place: the producer gets
+// a slot with write_slot(), fills it and publishes it with commit();
+// the consumer reads it with read_slot() and hands it back with
+// release().  Slots keep their capacity (e.g. vectors inside a
+// record), so the steady state does not allocate.
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+template<class T>
+class SPSCQueue {
+
+public:
+
+  // capacity is rounded up to a power of two
+  SPSCQueue(size_t capacity = 64): head(0), tail(0) {
+    size_t n = 1;
+    while(n < capacity)
+      n <<= 1;
+    slots.resize(n);
+    mask = n - 1;
+  }
+
+  size_t capacity() const {return slots.size();}
+
+  // Producer side, NULL when full
+  T* write_slot(){
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) == slots.size())
+      return NULL;
+    return &slots[h & mask];
+  }
+
+  void commit(){
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  // Consumer side, NULL when empty
+  T* read_slot(){
+    size_t t = tail.load(std::memory_order_relaxed);
+    if(head.load(std::memory_order_acquire) == t)
+      return NULL;
+    return &slots[t & mask];
+  }
+
+  void release(){
+    tail.store(tail.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  // Blocking versions, giving up (NULL) once stop is set
+  T* wait_write_slot(const std::atomic<bool>& stop){
+    return wait(&SPSCQueue::write_slot, stop);
+  }
+
+  T* wait_read_slot(const std::atomic<bool>& stop){
+    return wait(&SPSCQueue::read_slot, stop);
+  }
+
+private:
+
+  std::vector<T> slots;
+  size_t mask;
+
+  // producer and consumer indices on separate cache lines
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+
+  // spin briefly, then back off so that an idle stage costs nothing
+  T* wait(T* (SPSCQueue::*get)(), const std::atomic<bool>& stop){
+    for(int ntry=0; ; ++ntry){
+      T* slot = (this->*get)();
+      if(slot || stop.load(std::memory_order_relaxed))
+        return slot;
+      if(ntry < 64)
+        continue;
+      else if(ntry < 128)
+        std::this_thread::yield();
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,72 @@
+// Read the accepted events of a running monojet.exe -stream name
+//
+// Usage: stream_tail [-n (rows)] [-oldest] [-timeout (seconds)] [-every (k)] name
+//
+// Prints the stream's columns and then its rows as CSV, as they come,
+// until the generator closes the stream, -n rows are read or nothing
+// arrives for -timeout seconds (0: wait forever).  -oldest starts from
+// the oldest record still in the ring instead of the next one, -every k
+// prints one row in k (all are still read).  Ends with the number of
+// rows read and lost; see event_stream.h for the layout and protocol.
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "CmdLine/CmdLine.hh"
+#include "event_stream.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+
+  CmdLine cmdline(argc, argv);
+
+  long nmax = cmdline.value<long>("-n", -1);
+  double timeout = cmdline.value<double>("-timeout", 0);
+  long every = max(1L, cmdline.value<long>("-every", 1));
+
+  // the stream name: the argument that is neither an option nor a value
+  string name;
+  const vector<string>& args = cmdline.arguments();
+  for(size_t i=1; i<args.size(); ++i){
+    if(args[i] == "-oldest")
+      continue;
+    if(args[i][0] == '-'){
+      ++i;
+      continue;
+    }
+    name = args[i];
+  }
+
+  if(name == ""){
+    cerr<<"Usage: stream_tail [-n (rows)] [-oldest] [-timeout (seconds)] [-every (k)] (name)"<<endl;
+    return 1;
+  }
+
+  EventStreamReader reader;
+  if(!reader.attach(name, cmdline.present("-oldest")))
+    return 1;
+
+  vector<string> columns = reader.columns();
+  for(size_t c=0; c<columns.size(); ++c)
+    cout<<(c ? "," : "")<<columns[c];
+  cout<<"\n";
+
+  long nread = 0;
+  const double* row;
+  int status = 1;
+  while((nmax < 0 || nread < nmax) &&
+        (status = reader.next(row, timeout > 0 ? int(1000*timeout) : -1)) > 0){
+    if(nread++ % every != 0)
+      continue;
+    for(size_t c=0; c<columns.size(); ++c)
+      cout<<(c ? "," : "")<<row[c];
+    cout<<"\n";
+  }
+  cout.flush();
+
+  cerr<<"INFO: "<<nread<<" rows read, "<<reader.lost<<" lost"
+      <<(status == 0 ? ", timed out" : "")<<endl;
+  return 0;
+}
@@ -0,0 +1,63 @@
+"""
+Stand-in for a parton-level producer: replay an existing
+LHE file (plain or .gz) through a pipe or FIFO so that the
+shower/detector stage can read it while it is being written.
+
+Examples:
+
+	python replay_lhe.py events.lhe | ./monojet.exe -m lhe -i - -o out
+	mkfifo /tmp/events.fifo
+	python replay_lhe.py events.lhe.gz -o /tmp/events.fifo --rate 500 &
+	./monojet.exe -m lhe -i /tmp/events.fifo -o out
+"""
+
+import sys, os
+import gzip
+import time
+import argparse
+
+parser = argparse.ArgumentParser(description="Replay an LHE file through a pipe")
+parser.add_argument("input", help="LHE file, plain or gzipped")
+parser.add_argument("-o", "--output", default="-", help="FIFO or file to write to (default: stdout)")
+parser.add_argument("--rate", type=float, default=0, help="Events per second, 0 for as fast as possible")
+parser.add_argument("-n", "--nevents", type=int, default=-1, help="Stop after this many events")
+args = parser.parse_args()
+
+if args.input.endswith(".gz"):
+	fin = gzip.open(args.input, "rb")
+else:
+	fin = open(args.input, "rb")
+
+# Opening a FIFO blocks until the reader attaches
+if args.output == "-":
+	fout = getattr(sys.stdout, "buffer", sys.stdout)
+else:
+	fout = open(args.output, "wb")
+
+nevt = 0
+start = time.time()
+
+try:
+	for line in fin:
+		if args.nevents >= 0 and nevt >= args.nevents and line.startswith(b"<event"):
+			# skip the remaining events, keep the closing tag
+			for line in fin:
+				if line.startswith(b"</LesHouchesEvents"):
+					fout.write(line)
+			break
+
+		fout.write(line)
+
+		if line.startswith(b"</event>"):
+			nevt += 1
+			if args.rate > 0:
+				wait = start + nevt / args.rate - time.time()
+				if wait > 0:
+					fout.flush()
+					time.sleep(wait)
+	fout.flush()
+except IOError:
+	# the reader went away, e.g. monojet.exe -n reached
+	pass
+
+sys.stderr.write("replayed %d events\n" % nevt)
@@ -6,6 +6,9 @@ Pythia script.
 
 import sys, os
 import random
+import glob
+import struct
+import subprocess
 import numpy as np
 
 base_dir = "/group/hepheno/smsharma/Dark-Showers/"
@@ -34,21 +37,117 @@ source /group/hepheno/smsharma/Dark-Showers/env.sh
 source /group/hepheno/heptools/root/bin/thisroot.sh
 cd '''
 
+# Label of this scan, part of the seed key of every job
+run_label = "scan_dark_zprime"
+
+def derive_seed(key):
+	"""Seed of a job, as derive_seed in gen/seeds.h: 64-bit FNV-1a of the
+	length-prefixed key, mapped into Pythia's range 1..900000000"""
+	h = 14695981039346656037
+	for c in bytearray(struct.pack("<Q", len(key)) + key.encode()):
+		h ^= c
+		h = (h * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+	return 1 + h % 900000000
+
+def check_manifest(jobs):
+	"""Seeds and outputs must be unique across the scan, duplicated
+	samples would silently inflate the statistics"""
+	ok = True
+	for field in ["seed", "output"]:
+		seen = {}
+		for job in jobs:
+			if job[field] in seen:
+				print("ERROR: " + field + " " + str(job[field]) + " of " + job["key"] +
+					" already used by " + seen[job[field]])
+				ok = False
+			seen[job[field]] = job["key"]
+	return ok
+
 # lambda_range = np.linspace(0.01, 10, 20)
 lambda_range = np.linspace(1, 400, 10)
 rinv_range = np.linspace(0,1, 10)
 
+jobs = []
 for lambdo in lambda_range:
 	for rinv in rinv_range:
+		key = run_label + "/lambda=" + str(lambdo) + "/inv=" + str(rinv)
+		jobs.append({"key": key, "seed": derive_seed(key), "lambda": lambdo, "inv": rinv,
+			"output": "out_100_" + str(lambdo) + "_"+ str(rinv)[:5]})
+
+# One line per job: seed, key and output, to check later scans against
+manifest_name = "batch/manifest_" + run_label + ".txt"
+
+# Jobs of earlier scans count too
+previous = []
+for fname in glob.glob("batch/manifest_*.txt"):
+	if fname != manifest_name:
+		for line in open(fname):
+			seed, key, output = line.split()
+			previous.append({"key": key, "seed": int(seed), "output": output})
+
+if not check_manifest(previous + jobs):
+	sys.exit(1)
+
+manifest = open(manifest_name, "w")
+for job in jobs:
+	manifest.write(str(job["seed"]) + " " + job["key"] + " " + job["output"] + "\n")
+manifest.close()
 
+# Every run adds its cost to this database, used to size later jobs
+cost_db = base_dir + "/gen/cost.db"
+
+# Points already generated with the same options are linked from here
+output_cache = base_dir + "/gen/output_cache"
+
+# Options of each job, for sbatch or for gen/scan_runner
+def monojet_options(job):
+	return "-m lhe -w -i /group/hepheno/smsharma/Dark-Showers//MG5_aMC_v2_5_6_patch_signal/bin/sig_zprime/Events/events_100_100000_0.lhe -n 1000 -metmin 0 -nmatch 2 -lambda " +str(job["lambda"]) + " -inv " + str(job["inv"]) + " -seed_key " + job["key"] + " -cost_db " + cost_db + " -output_cache " + output_cache
+
+def job_resources(job):
+	"""Time limit and memory of a job predicted by gen/cost_predict from
+	the runs so far, the defaults of the batch header without them.  The
+	memory is at least the 3gb default: records of failed or empty runs
+	predict 0, and --mem=0 asks SLURM for all the memory of a node"""
+	if os.path.exists(cost_db):
+		try:
+			out = subprocess.check_output([base_dir + "/gen/cost_predict", "-db", cost_db] +
+				monojet_options(job).split(), universal_newlines=True)
+			for line in out.splitlines():
+				if line.startswith("resources "):
+					fields = dict(item.split("=") for item in line.split()[1:])
+					mem_mb = int(fields["mem"].rstrip("mb"))
+					return fields["time"], str(max(mem_mb, 3072)) + "mb"
+		except (OSError, ValueError, subprocess.CalledProcessError):
+			pass
+	return "00:10:00", "3gb"
+
+# With --local, write a grid for scan_runner on one machine instead of
+# submitting batch jobs
+if "--local" in sys.argv:
+	grid_name = "batch/grid_" + run_label + ".txt"
+	grid = open(grid_name, "w")
+	for job in jobs:
+		grid.write(job["output"] + " " + monojet_options(job) + "\n")
+	grid.close()
+	# cost= of each point for the sharding, when there are runs to go by
+	if os.path.exists(cost_db):
+		os.system(base_dir + "/gen/cost_predict -db " + cost_db + " -grid " + grid_name)
+	print("run from gen/: ./scan_runner " + os.path.abspath(grid_name))
+	sys.exit(0)
+
+for job in jobs:
+	lambdo = job["lambda"]
+	rinv = job["inv"]
 			
-		batchn = batch + base_dir +"/gen" + "\n" # Go to appropriate MG folder
-
-		# Copy over gridpack to temp
-		batchn += "./monojet.exe -m lhe -w -i /group/hepheno/smsharma/Dark-Showers//MG5_aMC_v2_5_6_patch_signal/bin/sig_zprime/Events/events_100_100000_0.lhe -o out_100_" + str(lambdo) + "_"+ str(rinv)[:5] +  " -n 1000 -metmin 0 -nmatch 2 -lambda " +str(lambdo) + " -inv " + str(rinv) +"\n" # Clean up previous gridpack
-		
-		fname = "batch/batch_gridpack_" + str(lambdo) + "_"+ str(rinv) + ".batch" # 
-		f=open(fname, "w")
-		f.write(batchn)
-		f.close()
-		os.system("sbatch " + fname);
\ No newline at end of file
+	time_limit, mem = job_resources(job)
+	batchn = batch.replace("-t 00:10:00", "-t " + time_limit).replace("--mem=3gb", "--mem=" + mem)
+	batchn += base_dir +"/gen" + "\n" # Go to appropriate MG folder
+
+	# Copy over gridpack to temp
+	batchn += "./monojet.exe -o " + job["output"] + " " + monojet_options(job) + "\n" # Clean up previous gridpack
+	
+	fname = "batch/batch_gridpack_" + str(lambdo) + "_"+ str(rinv) + ".batch" # 
+	f=open(fname, "w")
+	f.write(batchn)
+	f.close()
+	os.system("sbatch " + fname);